@@ -1,52 +1,176 @@
 #include <App.h>
 #include <a0.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include <string>
+
+#include "a0/api/actions/rest_cfg.hpp"
+#include "a0/api/actions/rest_export.hpp"
+#include "a0/api/actions/rest_import.hpp"
+#include "a0/api/actions/rest_latest.hpp"
+#include "a0/api/actions/rest_log_search.hpp"
 #include "a0/api/actions/rest_ls.hpp"
 #include "a0/api/actions/rest_pub.hpp"
 #include "a0/api/actions/rest_rpc.hpp"
+#include "a0/api/actions/rest_snapshot.hpp"
+#include "a0/api/actions/rest_stats.hpp"
 #include "a0/api/actions/rest_write.hpp"
+#include "a0/api/actions/ws_cfg.hpp"
 #include "a0/api/actions/ws_discover.hpp"
 #include "a0/api/actions/ws_log.hpp"
+#include "a0/api/actions/ws_merge.hpp"
+#include "a0/api/actions/ws_mux.hpp"
 #include "a0/api/actions/ws_prpc.hpp"
+#include "a0/api/actions/ws_psub.hpp"
 #include "a0/api/actions/ws_read.hpp"
+#include "a0/api/actions/ws_rpc.hpp"
 #include "a0/api/actions/ws_sub.hpp"
 #include "a0/api/global_state.hpp"
+#include "a0/api/loop_watchdog.hpp"
 
 // TODO(lshamis): The following decisions were made for backwards compatability.
 // * /wsapi/* is a weird path name.
 // * API version isn't part of the path: /api/v2/...?
 
 int main() {
+  // An empty PORT_STR disables TCP, ex: to only serve API_UNIX_SOCKET.
   auto PORT_STR = a0::api::env("PORT_STR", "24880");
+  auto UNIX_SOCKET = std::string(a0::api::env("API_UNIX_SOCKET", ""));
+  auto UNIX_SOCKET_MODE_STR = a0::api::env("API_UNIX_SOCKET_MODE", "");
+  auto OUTBOUND_BUDGET_MB_STR = a0::api::env("OUTBOUND_BUDGET_MB", "256");
+  auto BUFFER_POOL_MB_STR = a0::api::env("BUFFER_POOL_MB", "64");
+  auto RPC_TIMEOUT_MS_STR = a0::api::env("RPC_TIMEOUT_MS", "30000");
+  auto LOOP_WARN_MS_STR = a0::api::env("LOOP_WARN_MS", "50");
   setenv("A0_TOPIC", "api", /* replace = */ false);
 
-  int PORT;
+  int PORT = -1;
+  if (!PORT_STR.empty()) {
+    try {
+      PORT = std::stoi(PORT_STR.data());
+    } catch (const std::exception& err) {
+      fprintf(stderr, "Invalid port requested: %s\n", err.what());
+      return -1;
+    }
+  }
+  if (PORT < 0 && UNIX_SOCKET.empty()) {
+    fprintf(stderr, "Nothing to listen on: set PORT_STR or API_UNIX_SOCKET.\n");
+    return -1;
+  }
+
+  int UNIX_SOCKET_MODE = -1;
+  if (!UNIX_SOCKET_MODE_STR.empty()) {
+    try {
+      UNIX_SOCKET_MODE = std::stoi(UNIX_SOCKET_MODE_STR.data(), nullptr, 8);
+    } catch (const std::exception& err) {
+      fprintf(stderr, "Invalid unix socket mode requested: %s\n", err.what());
+      return -1;
+    }
+  }
+
   try {
-    PORT = std::stoi(PORT_STR.data());
+    a0::api::OutboundBudget::get()->limit = std::stoll(OUTBOUND_BUDGET_MB_STR.data()) << 20;
   } catch (const std::exception& err) {
-    fprintf(stderr, "Invalid port requested: %s\n", err.what());
+    fprintf(stderr, "Invalid outbound budget requested: %s\n", err.what());
+    return -1;
+  }
+
+  try {
+    a0::api::BufferPool::counters().max_bytes_held = std::stoll(BUFFER_POOL_MB_STR.data()) << 20;
+  } catch (const std::exception& err) {
+    fprintf(stderr, "Invalid buffer pool size requested: %s\n", err.what());
+    return -1;
+  }
+
+  try {
+    a0::api::RpcCalls::get()->default_timeout_ms = std::stoull(RPC_TIMEOUT_MS_STR.data());
+  } catch (const std::exception& err) {
+    fprintf(stderr, "Invalid rpc timeout requested: %s\n", err.what());
+    return -1;
+  }
+
+  try {
+    a0::api::LoopWatchdog::get()->threshold_ms = std::stoull(LOOP_WARN_MS_STR.data());
+  } catch (const std::exception& err) {
+    fprintf(stderr, "Invalid loop warning threshold requested: %s\n", err.what());
     return -1;
   }
 
   a0::Deadman deadman(a0::env::topic());
   uWS::App app;
-  app.get("/api/ls", a0::api::rest_ls);
-  app.post("/api/pub", a0::api::rest_pub);
-  app.post("/api/rpc", a0::api::rest_rpc);
-  app.post("/api/write", a0::api::rest_write);
+  app.get("/api/cfg", a0::api::watched("GET /api/cfg", a0::api::rest_cfg_get));
+  app.post("/api/cfg", a0::api::watched("POST /api/cfg", a0::api::rest_cfg_post));
+  app.get("/api/export", a0::api::watched("GET /api/export", a0::api::rest_export));
+  app.post("/api/import", a0::api::watched("POST /api/import", a0::api::rest_import));
+  app.get("/api/latest", a0::api::watched("GET /api/latest", a0::api::rest_latest));
+  app.post("/api/log/search", a0::api::watched("POST /api/log/search", a0::api::rest_log_search));
+  app.get("/api/ls", a0::api::watched("GET /api/ls", a0::api::rest_ls));
+  app.post("/api/pub", a0::api::watched("POST /api/pub", a0::api::rest_pub));
+  app.post("/api/rpc", a0::api::watched("POST /api/rpc", a0::api::rest_rpc));
+  app.post("/api/snapshot", a0::api::watched("POST /api/snapshot", a0::api::rest_snapshot));
+  app.get("/api/stats", a0::api::watched("GET /api/stats", a0::api::rest_stats));
+  app.post("/api/write", a0::api::watched("POST /api/write", a0::api::rest_write));
   app.ws<a0::api::WSLog::Data>("/wsapi/log", a0::api::WSLog::behavior());
   app.ws<a0::api::WSRead::Data>("/wsapi/read", a0::api::WSRead::behavior());
   app.ws<a0::api::WSSub::Data>("/wsapi/sub", a0::api::WSSub::behavior());
+  app.ws<a0::api::WSPsub::Data>("/wsapi/psub", a0::api::WSPsub::behavior());
   app.ws<a0::api::WSPrpc::Data>("/wsapi/prpc", a0::api::WSPrpc::behavior());
+  app.ws<a0::api::WSCfg::Data>("/wsapi/cfg", a0::api::WSCfg::behavior());
   app.ws<a0::api::WSDiscover::Data>("/wsapi/discover", a0::api::WSDiscover::behavior());
-  app.listen(PORT, [&](auto* socket) {
-    a0::api::global()->listen_socket = socket;
-    deadman.take();
-  });
+  app.ws<a0::api::WSMerge::Data>("/wsapi/merge", a0::api::WSMerge::behavior());
+  app.ws<a0::api::WSMux::Data>("/wsapi/mux", a0::api::WSMux::behavior());
+  app.ws<a0::api::WSRpc::Data>("/wsapi/rpc", a0::api::WSRpc::behavior());
+  if (PORT >= 0) {
+    app.listen(PORT, [&](auto* socket) {
+      if (!socket) {
+        fprintf(stderr, "Failed to listen on port %d\n", PORT);
+        exit(-1);
+      }
+      a0::api::global()->listen_sockets.push_back(socket);
+    });
+  }
+  if (!UNIX_SOCKET.empty()) {
+    // Replace the socket file left by a previous run, but nothing else.
+    struct stat st;
+    if (lstat(UNIX_SOCKET.c_str(), &st) == 0) {
+      if (!S_ISSOCK(st.st_mode)) {
+        fprintf(stderr, "Refusing to replace %s: not a unix socket\n", UNIX_SOCKET.c_str());
+        return -1;
+      }
+      unlink(UNIX_SOCKET.c_str());
+    }
+    // Access to the socket is controlled by its file permissions.
+    // They are set as it is created, so there's no window where it's more open.
+    mode_t prev_umask = umask(UNIX_SOCKET_MODE >= 0 ? ~UNIX_SOCKET_MODE & 0777 : 0077);
+    app.listen(
+        0,
+        [&](auto* socket) {
+          if (!socket) {
+            fprintf(stderr, "Failed to listen on unix socket %s\n", UNIX_SOCKET.c_str());
+            exit(-1);
+          }
+          a0::api::global()->listen_sockets.push_back(socket);
+        },
+        UNIX_SOCKET);
+    umask(prev_umask);
+  }
+  deadman.take();
 
   a0::api::global()->event_loop = uWS::Loop::get();
+  a0::api::global()->event_loop_thread = std::this_thread::get_id();
   a0::api::global()->running = true;
   a0::api::attach_signal_handler();
+  a0::api::LoopWatchdog::get()->start();
 
   app.run();
+
+  if (!UNIX_SOCKET.empty()) {
+    struct stat st;
+    if (lstat(UNIX_SOCKET.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+      unlink(UNIX_SOCKET.c_str());
+    }
+  }
+
+  // Stop the cache's subscribers before static destruction.
+  a0::api::LatestCache::get()->clear();
 }
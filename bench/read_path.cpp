@@ -0,0 +1,136 @@
+// Measures serializing a read/sub response from a locked transport:
+// * legacy: copy the flat packet, flatten the headers, encode the payload,
+//           build a nlohmann::json tree and dump it.
+// * direct: write_envelope() straight from the flat packet into one buffer.
+//
+// Reports heap allocations per packet and payload throughput in MB/s.
+//
+//   make bench
+
+#include <a0.h>
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "a0/api/encoders.hpp"
+#include "a0/api/envelope.hpp"
+#include "a0/api/strutil.hpp"
+
+static std::atomic<size_t> num_allocs{0};
+
+void* operator new(size_t size) {
+  num_allocs++;
+  if (void* ptr = std::malloc(size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+namespace a0::api {
+
+std::string legacy_envelope(a0_flat_packet_t fpkt_c,
+                            const std::function<std::string(std::string_view)>& encoder) {
+  std::vector<uint8_t> fpkt_copy_data(fpkt_c.buf.size);
+  a0_flat_packet_t fpkt_copy{{fpkt_copy_data.data(), fpkt_c.buf.size}};
+  memcpy(fpkt_copy.buf.data, fpkt_c.buf.data, fpkt_c.buf.size);
+
+  auto headers = strutil::flatten_headers(fpkt_copy);
+
+  a0_buf_t payload_buf;
+  a0_flat_packet_payload(fpkt_copy, &payload_buf);
+  auto payload = encoder(std::string_view((const char*)payload_buf.data, payload_buf.size));
+
+  return nlohmann::json({
+                            {"headers", headers},
+                            {"payload", payload},
+                        })
+      .dump();
+}
+
+std::string direct_envelope(a0_flat_packet_t fpkt, const PayloadEncoder& encoder) {
+  std::string out;
+  out.reserve(envelope_size_hint(fpkt.buf.size));
+  write_envelope(fpkt, "", encoder, out);
+  return out;
+}
+
+template <typename Fn>
+void measure(const char* name, size_t payload_size, Fn&& fn) {
+  // Aim for ~256MB of payload per measurement.
+  size_t iters = std::max<size_t>(16, (256 << 20) / std::max<size_t>(payload_size, 1));
+
+  size_t allocs_before = num_allocs;
+  auto start = std::chrono::steady_clock::now();
+  size_t out_bytes = 0;
+  for (size_t i = 0; i < iters; i++) {
+    out_bytes += fn().size();
+  }
+  auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  size_t allocs = num_allocs - allocs_before;
+
+  printf("  %-16s %8.2f allocs/pkt %10.1f MB/s  (%zu bytes/frame)\n",
+         name,
+         double(allocs) / iters,
+         double(payload_size) * iters / elapsed / (1 << 20),
+         out_bytes / iters);
+}
+
+}  // namespace a0::api
+
+int main() {
+  using namespace a0;
+  using namespace a0::api;
+
+  std::string path = "/dev/shm/a0_bench_read_path.a0";
+  std::filesystem::remove(path);
+
+  std::vector<size_t> payload_sizes = {64, 1 << 10, 64 << 10, 1 << 20};
+  {
+    Writer w(File(path));
+    w.push(add_standard_headers());
+    for (auto size : payload_sizes) {
+      std::string payload(size, 'x');
+      for (size_t i = 0; i < size; i++) {
+        payload[i] = "abcdefghijklmnopqrstuvwxyz {}:,\"0123456789"[i % 42];
+      }
+      w.write(Packet(std::move(payload)));
+    }
+  }
+
+  const std::vector<std::pair<std::string, std::function<std::string(std::string_view)>>> legacy_encoders = {
+      {"none", &none::encode},
+      {"base64", &base64::encode},
+  };
+
+  ReaderSyncZeroCopy reader(File(path), INIT_OLDEST, ITER_NEXT);
+  while (reader.has_next()) {
+    reader.next([&](TransportLocked, FlatPacket fpkt_cpp) {
+      a0_flat_packet_t fpkt = *fpkt_cpp.c;
+      a0_buf_t payload;
+      a0_flat_packet_payload(fpkt, &payload);
+      for (auto&& [enc_name, legacy_encoder] : legacy_encoders) {
+        const auto& encoder = Encoders().at(enc_name);
+        printf("payload %zu bytes, encoding %s\n", payload.size, enc_name.c_str());
+        measure("legacy", payload.size, [&]() { return legacy_envelope(fpkt, legacy_encoder); });
+        measure("direct", payload.size, [&]() { return direct_envelope(fpkt, encoder); });
+      }
+    });
+  }
+
+  std::filesystem::remove(path);
+}
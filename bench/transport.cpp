@@ -0,0 +1,246 @@
+// Measures /wsapi/sub throughput over loopback TCP and a unix domain socket.
+//
+// Starts bin/api listening on both, publishes a topic, then replays it from
+// OLDEST with the IMMEDIATE scheduler through each, with a minimal websocket
+// client. Reports messages/s and payload MB/s per transport.
+//
+//   make bench
+
+#include <a0.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "a0/api/strutil.hpp"
+
+namespace {
+
+constexpr int kPort = 24899;
+constexpr size_t kTopicBytes = 8 << 20;
+constexpr size_t kMaxPackets = 20000;
+
+// Blocking websocket client. Just enough to send a handshake and read frames.
+struct WSClient {
+  int fd{-1};
+  std::vector<char> buf;
+  size_t begin{0};
+  size_t end{0};
+
+  ~WSClient() {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  static int connect_tcp() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  static int connect_unix(const std::string& path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  void write_all(const std::string& data) {
+    size_t off = 0;
+    while (off < data.size()) {
+      ssize_t n = write(fd, data.data() + off, data.size() - off);
+      if (n <= 0) {
+        throw std::runtime_error("write failed");
+      }
+      off += n;
+    }
+  }
+
+  // Ensures at least n unread bytes are buffered.
+  void fill(size_t n) {
+    if (end - begin >= n) {
+      return;
+    }
+    if (begin) {
+      memmove(buf.data(), buf.data() + begin, end - begin);
+      end -= begin;
+      begin = 0;
+    }
+    if (buf.size() < n) {
+      buf.resize(std::max(n, size_t(1) << 20));
+    }
+    while (end < n) {
+      ssize_t r = read(fd, buf.data() + end, buf.size() - end);
+      if (r <= 0) {
+        throw std::runtime_error("connection closed");
+      }
+      end += r;
+    }
+  }
+
+  void upgrade(const std::string& path) {
+    write_all(a0::api::strutil::cat(
+        "GET ", path, " HTTP/1.1\r\n",
+        "Host: localhost\r\n",
+        "Upgrade: websocket\r\n",
+        "Connection: Upgrade\r\n",
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n",
+        "Sec-WebSocket-Version: 13\r\n\r\n"));
+    std::string resp;
+    while (resp.find("\r\n\r\n") == std::string::npos) {
+      fill(1);
+      resp.push_back(buf[begin++]);
+    }
+    if (resp.rfind("HTTP/1.1 101", 0) != 0) {
+      throw std::runtime_error("upgrade failed: " + resp);
+    }
+  }
+
+  // Clients mask their frames. A zero mask leaves the payload as-is.
+  void send_text(const std::string& msg) {
+    std::string frame = "\x81";
+    if (msg.size() < 126) {
+      frame.push_back(char(0x80 | msg.size()));
+    } else {
+      frame.push_back(char(0x80 | 126));
+      frame.push_back(char(msg.size() >> 8));
+      frame.push_back(char(msg.size() & 0xFF));
+    }
+    frame.append(4, '\0');
+    frame += msg;
+    write_all(frame);
+  }
+
+  // Returns the payload size of the next frame, and skips over it.
+  size_t skip_frame() {
+    fill(2);
+    uint8_t len7 = buf[begin + 1] & 0x7F;
+    size_t hdr = 2;
+    size_t len = len7;
+    if (len7 == 126) {
+      fill(4);
+      len = (uint8_t(buf[begin + 2]) << 8) | uint8_t(buf[begin + 3]);
+      hdr = 4;
+    } else if (len7 == 127) {
+      fill(10);
+      len = 0;
+      for (int i = 0; i < 8; i++) {
+        len = (len << 8) | uint8_t(buf[begin + 2 + i]);
+      }
+      hdr = 10;
+    }
+    fill(hdr + len);
+    begin += hdr + len;
+    return len;
+  }
+};
+
+pid_t start_api(const std::string& unix_socket) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    setenv("PORT_STR", std::to_string(kPort).c_str(), true);
+    setenv("API_UNIX_SOCKET", unix_socket.c_str(), true);
+    execl("bin/api", "bin/api", nullptr);
+    perror("exec bin/api");
+    _exit(1);
+  }
+
+  // Wait for both listeners.
+  for (int i = 0; i < 500; i++) {
+    int tcp = WSClient::connect_tcp();
+    int uds = WSClient::connect_unix(unix_socket);
+    if (tcp >= 0) {
+      close(tcp);
+    }
+    if (uds >= 0) {
+      close(uds);
+    }
+    if (tcp >= 0 && uds >= 0) {
+      return pid;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  kill(pid, SIGKILL);
+  throw std::runtime_error("bin/api didn't start");
+}
+
+void measure(const char* name, int fd, size_t num_packets, size_t payload_size) {
+  WSClient client;
+  client.fd = fd;
+  client.upgrade("/wsapi/sub");
+
+  auto start = std::chrono::steady_clock::now();
+  client.send_text(R"({"topic":"bench","init":"OLDEST","scheduler":"IMMEDIATE"})");
+  size_t frame_bytes = 0;
+  for (size_t i = 0; i < num_packets; i++) {
+    frame_bytes += client.skip_frame();
+  }
+  auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("  %-6s %10.0f msgs/s %10.1f MB/s  (%zu bytes/frame)\n",
+         name,
+         num_packets / elapsed,
+         double(payload_size) * num_packets / elapsed / (1 << 20),
+         frame_bytes / num_packets);
+}
+
+}  // namespace
+
+int main() {
+  auto root = std::filesystem::temp_directory_path() / "a0_bench_transport";
+  std::filesystem::remove_all(root);
+  std::filesystem::create_directories(root);
+  setenv("A0_ROOT", root.c_str(), true);
+  std::string unix_socket = root / "api.sock";
+
+  pid_t api = start_api(unix_socket);
+
+  for (size_t payload_size : {64, 1 << 10, 64 << 10}) {
+    std::filesystem::remove(root / "bench.pubsub.a0");
+    size_t num_packets = std::min(kMaxPackets, kTopicBytes / (payload_size + 512));
+    {
+      a0::Publisher p("bench");
+      std::string payload(payload_size, 'x');
+      for (size_t i = 0; i < num_packets; i++) {
+        p.pub(payload);
+      }
+    }
+
+    printf("payload %zu bytes, %zu packets\n", payload_size, num_packets);
+    measure("tcp", WSClient::connect_tcp(), num_packets, payload_size);
+    measure("unix", WSClient::connect_unix(unix_socket), num_packets, payload_size);
+  }
+
+  kill(api, SIGTERM);
+  waitpid(api, nullptr, 0);
+  std::filesystem::remove_all(root);
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <App.h>
+#include <a0.h>
+#include <fcntl.h>
+#include <nlohmann/json.hpp>
+
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "a0/api/request_message.hpp"
+#include "a0/api/rest_common.hpp"
+#include "a0/api/strutil.hpp"
+
+namespace a0::api {
+
+// Cfg handles, and the last document read through each.
+// Only used within the event loop.
+struct RestCfgEntry {
+  std::unique_ptr<Cfg> cfg;
+  // The cfg's file, to check for a first write without blocking.
+  std::unique_ptr<File> file;
+  std::string pkt_id;
+  std::shared_ptr<const nlohmann::json> doc;
+};
+
+A0_STATIC_INLINE
+RestCfgEntry& rest_cfg_entry(const std::string& topic) {
+  static std::map<std::string, RestCfgEntry> entries;
+  auto it = entries.find(topic);
+  if (it == entries.end()) {
+    // Throws on an invalid topic, before anything is cached.
+    auto cfg = std::make_unique<Cfg>(topic);
+    auto file = std::make_unique<File>(topic_path(env::topic_tmpl_cfg(), topic));
+    it = entries.emplace(topic, RestCfgEntry{std::move(cfg), std::move(file), "", nullptr}).first;
+  }
+  return it->second;
+}
+
+// The current document. Only parsed when it has changed since the last read.
+// Returns nullptr if no cfg has been written yet.
+A0_STATIC_INLINE
+std::shared_ptr<const nlohmann::json> rest_cfg_read(const std::string& topic) {
+  auto& entry = rest_cfg_entry(topic);
+
+  // Runs on the event loop. A blocking read would wait for the first write.
+  // Only an unwritten cfg is reported as such. Other failures are thrown.
+  a0_transport_t transport;
+  a0_transport_locked_t tlk;
+  if (a0_transport_init(&transport, entry.file->c->arena) != A0_OK ||
+      a0_transport_lock(&transport, &tlk) != A0_OK) {
+    throw std::runtime_error(strutil::cat("Failed to open cfg: ", topic));
+  }
+  bool empty = true;
+  a0_transport_empty(tlk, &empty);
+  a0_transport_unlock(tlk);
+  if (empty) {
+    return nullptr;
+  }
+
+  Packet pkt = entry.cfg->read(O_NONBLOCK);
+  if (!entry.doc || pkt.id() != entry.pkt_id) {
+    auto doc = nlohmann::json::parse(pkt.payload(), nullptr, false);
+    if (doc.is_discarded()) {
+      throw std::invalid_argument("Cfg is not json.");
+    }
+    entry.pkt_id = std::string(pkt.id());
+    entry.doc = std::make_shared<const nlohmann::json>(std::move(doc));
+  }
+  return entry.doc;
+}
+
+// fetch(`http://${api_addr}/api/cfg?` + new URLSearchParams([
+//     ["topic", "..."],                 // required
+//     ["path", "/json/pointer"],        // optional, defaults to the whole document
+// ]))
+// .then((r) => { return r.json() })
+// .then((cfg) => { console.log(cfg) })
+A0_STATIC_INLINE
+void rest_cfg_get(uWS::HttpResponse<false>* res,
+                  uWS::HttpRequest* req) {
+  std::string topic;
+  std::string path;
+  for (auto&& [key, val] : query_params(req)) {
+    if (key == "topic") {
+      topic = val;
+    } else if (key == "path") {
+      path = val;
+    }
+  }
+
+  try {
+    if (topic.empty()) {
+      throw std::invalid_argument("Request missing required field: topic");
+    }
+    nlohmann::json::json_pointer ptr;
+    try {
+      ptr = nlohmann::json::json_pointer(path);
+    } catch (std::exception& e) {
+      throw std::invalid_argument(
+          strutil::cat("Request field has incorrect format. field: path  error: ", e.what()));
+    }
+
+    auto doc = rest_cfg_read(topic);
+    if (!doc) {
+      rest_respond(res, "404", {}, "Cfg has not been written.");
+      return;
+    }
+    if (!doc->contains(ptr)) {
+      rest_respond(res, "404", {}, strutil::cat("Cfg has no value at path: ", path));
+      return;
+    }
+    rest_respond(res, "200", {{"Content-Type", "application/json"}}, doc->at(ptr).dump());
+  } catch (std::exception& e) {
+    rest_respond(res, "400", {}, e.what());
+  }
+}
+
+// fetch(`http://${api_addr}/api/cfg`, {
+//     method: "POST",
+//     body: JSON.stringify({
+//         topic: "...",                     // required
+//         patch: {...},                     // required, json merge-patch (RFC 7386)
+//     })
+// })
+// .then((r) => { return r.text() })
+// .then((msg) => { console.assert(msg == "success", msg) })
+A0_STATIC_INLINE
+void rest_cfg_post(uWS::HttpResponse<false>* res,
+                   uWS::HttpRequest* req) {
+  rest_common(res, req, [res](const RequestMessage& req_msg) {
+    // Check required fields.
+    req_msg.require("topic");
+    req_msg.require("patch");
+
+    // Perform requested action.
+    // The patch is applied under the cfg's lock, so concurrent writers don't lose fields.
+    rest_cfg_entry(req_msg.topic).cfg->mergepatch(req_msg.raw_msg.at("patch"));
+
+    rest_respond(res, "200", {}, "success");
+  });
+}
+
+}  // namespace a0::api
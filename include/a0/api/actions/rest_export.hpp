@@ -0,0 +1,322 @@
+#pragma once
+
+#include <App.h>
+#include <a0.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include "a0/api/encoders.hpp"
+#include "a0/api/envelope.hpp"
+#include "a0/api/global_state.hpp"
+#include "a0/api/gzip.hpp"
+#include "a0/api/loop_watchdog.hpp"
+#include "a0/api/rest_common.hpp"
+#include "a0/api/scope.hpp"
+#include "a0/api/strutil.hpp"
+
+namespace a0::api {
+
+// One export: a reader over the file, feeding the response in large batches.
+//
+// The reader fills a batch without leaving the transport, compresses it if
+// asked, then hands it to the event loop. The event loop writes what it has,
+// and stops while the socket is backpressured. The reader waits, with the
+// transport unlocked, while too much is pending. Only used within the event
+// loop, except where noted.
+struct RestExport {
+  // Handed to the event loop at a time.
+  static constexpr size_t kBatchBytes = 1 << 20;
+  // The reader waits while more than this is pending.
+  static constexpr size_t kMaxPendingBytes = 8 << 20;
+
+  enum class Format { RAW, NDJSON };
+
+  uWS::HttpResponse<false>* res;
+  Format format;
+  PayloadEncoder response_encoder;
+  uint64_t seq_min{0};
+  uint64_t seq_max{std::numeric_limits<uint64_t>::max()};
+  // The newest packet when the export started. Later packets aren't part of it.
+  uint64_t end_seq{0};
+  bool backpressured{false};
+
+  // Only used on the A0 thread, once the reader starts.
+  std::string batch;
+  std::unique_ptr<GzipDeflate> gzip;
+  std::string compressed;
+  bool ended{false};
+
+  // Guarded by mu.
+  std::mutex mu;
+  std::condition_variable cv;
+  std::string pending;
+  bool done{false};
+  bool closed{false};
+  bool flush_scheduled{false};
+
+  // Declared last, so it stops before the rest is freed.
+  std::unique_ptr<ReaderZeroCopy> reader;
+};
+
+A0_STATIC_INLINE
+std::unordered_map<uint64_t, std::unique_ptr<RestExport>>& rest_exports() {
+  static std::unordered_map<uint64_t, std::unique_ptr<RestExport>> exports;
+  return exports;
+}
+
+A0_STATIC_INLINE
+void rest_export_close(uint64_t export_id) {
+  auto it = rest_exports().find(export_id);
+  if (it == rest_exports().end()) {
+    return;
+  }
+  // Stops the reader on return. Wake it first, in case it's waiting for space.
+  auto ex = std::move(it->second);
+  rest_exports().erase(it);
+  {
+    std::unique_lock<std::mutex> lk{ex->mu};
+    ex->closed = true;
+  }
+  ex->cv.notify_all();
+}
+
+A0_STATIC_INLINE
+void rest_export_flush(uint64_t export_id) {
+  auto it = rest_exports().find(export_id);
+  if (it == rest_exports().end()) {
+    return;
+  }
+  auto* ex = it->second.get();
+
+  std::string chunk;
+  bool done;
+  {
+    std::unique_lock<std::mutex> lk{ex->mu};
+    ex->flush_scheduled = false;
+    if (ex->backpressured) {
+      // onWritable flushes when the socket drains.
+      return;
+    }
+    chunk.swap(ex->pending);
+    done = ex->done;
+  }
+  ex->cv.notify_all();
+
+  bool ok = chunk.empty() || ex->res->write(chunk);
+  if (done) {
+    // Anything uWS couldn't write yet is sent before the connection is finished.
+    ex->res->end();
+    rest_export_close(export_id);
+    return;
+  }
+  ex->backpressured = !ok;
+}
+
+// Runs on A0 thread, with the transport unlocked.
+A0_STATIC_INLINE
+void rest_export_handoff(RestExport* ex, uint64_t export_id, bool last) {
+  if (ex->gzip) {
+    // Compressed here, so the event loop only writes bytes.
+    ex->compressed.clear();
+    ex->gzip->write(ex->batch, last, [ex](std::string_view part) { ex->compressed += part; });
+    ex->batch.swap(ex->compressed);
+  }
+
+  std::unique_lock<std::mutex> lk{ex->mu};
+  while (!ex->closed && global()->running && ex->pending.size() >= RestExport::kMaxPendingBytes) {
+    ex->cv.wait_for(lk, std::chrono::milliseconds(100));
+  }
+  if (ex->closed) {
+    return;
+  }
+  if (ex->pending.empty()) {
+    // Keep the batch's capacity on the A0 side.
+    ex->pending.swap(ex->batch);
+  } else {
+    ex->pending += ex->batch;
+    ex->batch.clear();
+  }
+  ex->done = last;
+  if (!ex->flush_scheduled) {
+    ex->flush_scheduled = true;
+    defer("rest_export", [export_id]() { rest_export_flush(export_id); });
+  }
+}
+
+// Runs on A0 thread.
+A0_STATIC_INLINE
+void rest_export_record(RestExport* ex, uint64_t export_id, TransportLocked tlk, FlatPacket fpkt_cpp) {
+  if (!global()->running || ex->ended) {
+    return;
+  }
+
+  uint64_t seq = tlk.frame().hdr.seq;
+  if (seq >= ex->seq_min && seq <= ex->end_seq) {
+    a0_flat_packet_t fpkt = *fpkt_cpp.c;
+    if (ex->format == RestExport::Format::RAW) {
+      // Little-endian size, then the flat packet, as /api/import reads them.
+      uint64_t size = fpkt.buf.size;
+      for (int i = 0; i < 8; i++) {
+        ex->batch.push_back(char(size >> (8 * i)));
+      }
+      ex->batch.append((const char*)fpkt.buf.data, fpkt.buf.size);
+    } else {
+      std::string fields = strutil::cat("\"seq\":", seq, ",");
+      size_t mark = ex->batch.size();
+      try {
+        write_envelope(fpkt, fields, ex->response_encoder, ex->batch);
+      } catch (std::exception& e) {
+        ex->batch.resize(mark);
+        ex->batch += strutil::cat("{", fields, "\"error\":", nlohmann::json(e.what()).dump(), "}");
+      }
+      ex->batch.push_back('\n');
+    }
+  }
+
+  // Also ends if the last packet was evicted before the reader got to it.
+  bool last = seq >= ex->end_seq;
+  ex->ended = last;
+  if (last || ex->batch.size() >= RestExport::kBatchBytes) {
+    // Unlock the transport while waiting for the event loop. It needs to be relocked before the function returns.
+    auto eos_relock_transport = scope_unlock_transport(*tlk.c);
+    rest_export_handoff(ex, export_id, last);
+  }
+}
+
+// fetch(`http://${api_addr}/api/export?` + new URLSearchParams([
+//     ["path", "..."],                  // required
+//     ["format", "raw"],                // optional, one of "raw", "ndjson"
+//     ["gzip", "0"],                    // optional, "1" to compress the response
+//     ["seq_min", "0"],                 // optional, first sequence number to include
+//     ["seq_max", "..."],               // optional, last sequence number to include
+//     ["response_encoding", "auto"],    // optional, ndjson payloads. one of "none", "base64", "json", "auto"
+// ]))
+// .then((r) => { return r.blob() })
+// .then((blob) => { ... })
+A0_STATIC_INLINE
+void rest_export(uWS::HttpResponse<false>* res,
+                 uWS::HttpRequest* req) {
+  auto ex = std::make_unique<RestExport>();
+  ex->res = res;
+  ex->format = RestExport::Format::RAW;
+  ex->response_encoder = Encoders().at("auto");
+  std::string path;
+
+  try {
+    auto parse_seq = [](const std::string& key, const std::string& val) {
+      try {
+        return uint64_t(std::stoull(val));
+      } catch (std::exception& e) {
+        throw std::invalid_argument(
+            strutil::cat("Request field has incorrect format. field: ", key, "  error: ", e.what()));
+      }
+    };
+    for (auto&& [key, val] : query_params(req)) {
+      if (key == "path") {
+        path = val;
+      } else if (key == "format") {
+        if (val == "raw") {
+          ex->format = RestExport::Format::RAW;
+        } else if (val == "ndjson") {
+          ex->format = RestExport::Format::NDJSON;
+        } else {
+          throw std::invalid_argument(strutil::cat("Request has unknown value for field: format  value: ", val));
+        }
+      } else if (key == "gzip") {
+        if (val == "1" || val == "true") {
+          ex->gzip = std::make_unique<GzipDeflate>();
+        }
+      } else if (key == "seq_min") {
+        ex->seq_min = parse_seq(key, val);
+      } else if (key == "seq_max") {
+        ex->seq_max = parse_seq(key, val);
+      } else if (key == "response_encoding") {
+        if (!Encoders().count(val)) {
+          throw std::invalid_argument(
+              strutil::cat("Request has unknown value for field: response_encoding  value: ", val));
+        }
+        ex->response_encoder = Encoders().at(val);
+      }
+    }
+    if (path.empty()) {
+      throw std::invalid_argument("Request missing required field: path");
+    }
+
+    // Opening the file would create it.
+    std::filesystem::path full_path = path;
+    if (full_path.is_relative()) {
+      full_path = std::filesystem::path(env::root()) / full_path;
+    }
+    if (!std::filesystem::exists(full_path)) {
+      rest_respond(res, "404", {}, strutil::cat("File does not exist: ", path));
+      return;
+    }
+
+    // The reader doesn't call back on an empty file, so check up front.
+    // Also fixes the end of the export.
+    File file(path);
+    a0_transport_t transport;
+    a0_transport_locked_t tlk;
+    if (a0_transport_init(&transport, file.c->arena) != A0_OK || a0_transport_lock(&transport, &tlk) != A0_OK) {
+      throw std::runtime_error(strutil::cat("Failed to open file: ", path));
+    }
+    bool empty = true;
+    uint64_t seq_high = 0;
+    a0_transport_empty(tlk, &empty);
+    a0_transport_seq_high(tlk, &seq_high);
+    a0_transport_unlock(tlk);
+    ex->end_seq = std::min(seq_high, ex->seq_max);
+
+    res->writeStatus("200 OK");
+    res->writeHeader("Access-Control-Allow-Origin", "*");
+    res->writeHeader("Content-Type",
+                     ex->format == RestExport::Format::RAW ? "application/octet-stream" : "application/x-ndjson");
+    if (ex->gzip) {
+      res->writeHeader("Content-Encoding", "gzip");
+    }
+
+    if (empty) {
+      std::string body;
+      if (ex->gzip) {
+        ex->gzip->write({}, true, [&](std::string_view part) { body += part; });
+      }
+      res->end(body);
+      return;
+    }
+
+    static uint64_t next_export_id = 0;
+    uint64_t export_id = ++next_export_id;
+    // Callbacks are deferred to the event loop, so none run before the headers are written.
+    ex->reader = std::make_unique<ReaderZeroCopy>(
+        file, INIT_OLDEST, ITER_NEXT,
+        [ex = ex.get(), export_id](TransportLocked tlk, FlatPacket fpkt) {
+          rest_export_record(ex, export_id, tlk, fpkt);
+        });
+    rest_exports()[export_id] = std::move(ex);
+
+    res->onWritable([export_id](uintmax_t) {
+      auto it = rest_exports().find(export_id);
+      if (it != rest_exports().end()) {
+        it->second->backpressured = false;
+        rest_export_flush(export_id);
+      }
+      return true;
+    });
+    res->onAborted([export_id]() { rest_export_close(export_id); });
+  } catch (std::exception& e) {
+    rest_respond(res, "400", {}, e.what());
+  }
+}
+
+}  // namespace a0::api
@@ -0,0 +1,397 @@
+#pragma once
+
+#include <App.h>
+#include <a0.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "a0/api/encoders.hpp"
+#include "a0/api/gzip.hpp"
+#include "a0/api/loop_watchdog.hpp"
+#include "a0/api/rest_common.hpp"
+#include "a0/api/strutil.hpp"
+
+namespace a0::api {
+
+// Checks a flat packet before a0 reads it, since the body is untrusted.
+// Layout:
+//   [id: a0_uuid_t][num_headers: size_t][offsets: size_t x (2 * num_headers + 1)][header strings][payload]
+// Offsets are from the start of the packet, to each header key and value, then the payload.
+// Header strings are null terminated.
+A0_STATIC_INLINE
+bool flat_packet_valid(std::string_view flat) {
+  size_t index = sizeof(a0_uuid_t) + sizeof(size_t);
+  if (flat.size() < index) {
+    return false;
+  }
+  size_t num_headers;
+  memcpy(&num_headers, flat.data() + sizeof(a0_uuid_t), sizeof(size_t));
+  if (num_headers > (flat.size() - index) / sizeof(size_t) / 2) {
+    return false;
+  }
+  size_t num_offsets = 2 * num_headers + 1;
+  size_t prev = index + num_offsets * sizeof(size_t);
+  if (prev > flat.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < num_offsets; i++) {
+    size_t off;
+    memcpy(&off, flat.data() + index + i * sizeof(size_t), sizeof(size_t));
+    if (off < prev || off > flat.size() || (i > 0 && flat[off - 1] != '\0')) {
+      return false;
+    }
+    prev = off;
+  }
+  return true;
+}
+
+// The text of the last member named key, as written, in a valid json object.
+// Empty if there is none. Lets embedded json payloads be written back byte for byte.
+A0_STATIC_INLINE
+std::string_view json_member_text(std::string_view obj, std::string_view key) {
+  size_t i = 0;
+  auto skip_ws = [&]() {
+    while (i < obj.size() && (obj[i] == ' ' || obj[i] == '\t' || obj[i] == '\r' || obj[i] == '\n')) {
+      i++;
+    }
+  };
+  // At an opening quote. Stops past the closing one.
+  auto skip_string = [&]() {
+    for (i++; i < obj.size() && obj[i] != '"'; i++) {
+      if (obj[i] == '\\') {
+        i++;
+      }
+    }
+    i++;
+  };
+  auto skip_value = [&]() {
+    int depth = 0;
+    while (i < obj.size()) {
+      char c = obj[i];
+      if (c == '"') {
+        skip_string();
+        if (!depth) {
+          return;
+        }
+        continue;
+      }
+      if (c == '{' || c == '[') {
+        depth++;
+      } else if (c == '}' || c == ']') {
+        if (!depth) {
+          return;
+        }
+        if (!--depth) {
+          i++;
+          return;
+        }
+      } else if (!depth && (c == ',' || c == ' ' || c == '\t' || c == '\r' || c == '\n')) {
+        return;
+      }
+      i++;
+    }
+  };
+
+  std::string_view found;
+  skip_ws();
+  i++;  // '{'
+  while (true) {
+    skip_ws();
+    if (i >= obj.size() || obj[i] != '"') {
+      return found;
+    }
+    size_t key_start = i;
+    skip_string();
+    std::string_view key_text = obj.substr(key_start, i - key_start);
+    skip_ws();
+    i++;  // ':'
+    skip_ws();
+    size_t val_start = i;
+    skip_value();
+    std::string_view val = obj.substr(val_start, i - val_start);
+
+    bool match = key_text.find('\\') == std::string_view::npos
+                     ? key_text.substr(1, key_text.size() - 2) == key
+                     : nlohmann::json::parse(key_text).get<std::string>() == key;
+    if (match) {
+      found = val;
+    }
+    skip_ws();
+    if (i < obj.size() && obj[i] == ',') {
+      i++;
+    }
+  }
+}
+
+// One upload, parsed as it arrives. Only used within the event loop.
+//
+// At most one partial record is buffered, and gzip input is inflated in
+// bounded pieces, so memory doesn't grow with the size of the upload.
+struct RestImport {
+  static constexpr size_t kMaxRecordBytes = 64 << 20;
+
+  enum class Format { RAW, NDJSON };
+
+  Format format{Format::RAW};
+  bool standard_headers{false};
+  std::function<std::string(std::string_view)> decoder;
+  std::unique_ptr<GzipInflate> gzip;
+  std::unique_ptr<Writer> writer;
+
+  std::string buf;
+  // Leading bytes of buf already searched for a newline, without one.
+  size_t newline_free{0};
+  uint64_t written{0};
+
+  void feed(std::string_view chunk) {
+    if (!gzip) {
+      buf += chunk;
+      parse(false);
+      return;
+    }
+    gzip->write(chunk, [this](std::string_view part) {
+      buf += part;
+      parse(false);
+    });
+  }
+
+  void finish() {
+    if (gzip && !gzip->finished()) {
+      throw std::invalid_argument("Invalid gzip body: truncated");
+    }
+    parse(true);
+    if (!buf.empty()) {
+      throw invalid_record("truncated");
+    }
+  }
+
+ private:
+  std::invalid_argument invalid_record(std::string_view why) const {
+    return std::invalid_argument(strutil::cat("Invalid record ", written + 1, ": ", why));
+  }
+
+  // Writes each complete record in buf, and drops it. With at_end, a final
+  // ndjson line needs no newline.
+  void parse(bool at_end) {
+    size_t pos = 0;
+    if (format == Format::RAW) {
+      while (buf.size() - pos >= 8) {
+        uint64_t size = 0;
+        for (int i = 0; i < 8; i++) {
+          size |= uint64_t(uint8_t(buf[pos + i])) << (8 * i);
+        }
+        if (size > kMaxRecordBytes) {
+          throw invalid_record("too large");
+        }
+        if (buf.size() - pos - 8 < size) {
+          break;
+        }
+        write_raw(std::string_view(buf).substr(pos + 8, size));
+        pos += 8 + size;
+      }
+    } else {
+      while (pos < buf.size()) {
+        // A long line arrives over many chunks. Only search what's new.
+        size_t end = buf.find('\n', std::max(pos, newline_free));
+        if (end == std::string::npos) {
+          if (!at_end) {
+            break;
+          }
+          end = buf.size();
+        }
+        write_ndjson(std::string_view(buf).substr(pos, end - pos));
+        pos = std::min(end + 1, buf.size());
+      }
+      if (buf.size() - pos > kMaxRecordBytes) {
+        throw invalid_record("too large");
+      }
+      newline_free = buf.size() - pos;
+    }
+    buf.erase(0, pos);
+  }
+
+  void write_raw(std::string_view record) {
+    if (!flat_packet_valid(record)) {
+      throw invalid_record("not a flat packet");
+    }
+    // A copy, so a0 reads its offsets aligned.
+    std::string flat(record);
+    a0_flat_packet_t fpkt = {{(uint8_t*)flat.data(), flat.size()}};
+    a0_buf_t payload;
+    a0_flat_packet_payload(fpkt, &payload);
+    write(strutil::flatten_headers(fpkt), std::string((const char*)payload.data, payload.size));
+  }
+
+  void write_ndjson(std::string_view line) {
+    if (line.find_first_not_of(" \t\r") == std::string_view::npos) {
+      return;
+    }
+    auto rec = nlohmann::json::parse(line, nullptr, false);
+    if (rec.is_discarded() || !rec.is_object()) {
+      throw invalid_record("must be a json object");
+    }
+    if (!rec.contains("payload")) {
+      throw invalid_record("missing payload");
+    }
+
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string payload;
+    try {
+      if (rec.contains("headers")) {
+        rec.at("headers").get_to(headers);
+      }
+      auto& payload_field = rec.at("payload");
+      std::string encoding = rec.value("encoding", "");
+      if (encoding == "json" || (!payload_field.is_string() && encoding.empty())) {
+        // Embedded by the "json" or "auto" encodings. Written back as it appears,
+        // since re-serializing would reorder keys and reformat numbers.
+        payload = std::string(json_member_text(line, "payload"));
+      } else if (!payload_field.is_string()) {
+        throw std::invalid_argument(strutil::cat("payload must be a string with encoding: ", encoding));
+      } else if (encoding == "base64") {
+        payload = base64::decode(payload_field.get<std::string>());
+      } else if (encoding == "none") {
+        payload = payload_field.get<std::string>();
+      } else if (encoding.empty()) {
+        payload = decoder(payload_field.get<std::string>());
+      } else {
+        throw std::invalid_argument(strutil::cat("unknown encoding: ", encoding));
+      }
+    } catch (std::exception& e) {
+      throw invalid_record(e.what());
+    }
+    write(std::move(headers), std::move(payload));
+  }
+
+  void write(std::vector<std::pair<std::string, std::string>> headers, std::string payload) {
+    std::unordered_multimap<std::string, std::string> hdrs;
+    bool has_time_mono = false;
+    bool has_time_wall = false;
+    for (auto&& [key, val] : headers) {
+      if (standard_headers) {
+        // Describe the recording, not this file. The writer adds new ones.
+        if (key == "a0_writer_id" || key == "a0_writer_seq" || key == "a0_transport_seq") {
+          continue;
+        }
+        has_time_mono |= key == "a0_time_mono";
+        has_time_wall |= key == "a0_time_wall";
+      }
+      hdrs.insert({std::move(key), std::move(val)});
+    }
+
+    // Recorded timestamps are kept. Packets without them are stamped now.
+    if (standard_headers && !has_time_mono) {
+      a0_time_mono_t now;
+      a0_time_mono_now(&now);
+      char now_str[20];
+      a0_time_mono_str(now, now_str);
+      hdrs.insert({"a0_time_mono", now_str});
+    }
+    if (standard_headers && !has_time_wall) {
+      a0_time_wall_t now;
+      a0_time_wall_now(&now);
+      char now_str[36];
+      a0_time_wall_str(now, now_str);
+      hdrs.insert({"a0_time_wall", now_str});
+    }
+
+    writer->write(Packet(std::move(hdrs), std::move(payload)));
+    written++;
+  }
+};
+
+// fetch(`http://${api_addr}/api/import?` + new URLSearchParams([
+//     ["path", "..."],                  // required
+//     ["format", "raw"],                // optional, one of "raw", "ndjson"
+//     ["gzip", "0"],                    // optional, "1" if the body is compressed. Also set by Content-Encoding
+//     ["standard_headers", "0"],        // optional, "1" to add standard headers, keeping recorded timestamps
+//     ["request_encoding", "none"],     // optional, ndjson payloads without an encoding. one of "none", "base64"
+// ]), {
+//     method: "POST",
+//     body: blob,
+// })
+// .then((r) => { return r.json() })
+// .then((result) => { console.log(result.written) })
+A0_STATIC_INLINE
+void rest_import(uWS::HttpResponse<false>* res,
+                 uWS::HttpRequest* req) {
+  auto imp = std::make_shared<RestImport>();
+  imp->decoder = Decoders().at("");
+  bool gzip = req->getHeader("content-encoding") == "gzip";
+  std::string path;
+
+  res->onAborted([]() {});
+
+  try {
+    for (auto&& [key, val] : query_params(req)) {
+      if (key == "path") {
+        path = val;
+      } else if (key == "format") {
+        if (val == "raw") {
+          imp->format = RestImport::Format::RAW;
+        } else if (val == "ndjson") {
+          imp->format = RestImport::Format::NDJSON;
+        } else {
+          throw std::invalid_argument(strutil::cat("Request has unknown value for field: format  value: ", val));
+        }
+      } else if (key == "gzip") {
+        gzip |= val == "1" || val == "true";
+      } else if (key == "standard_headers") {
+        imp->standard_headers = val == "1" || val == "true";
+      } else if (key == "request_encoding") {
+        if (!Decoders().count(val)) {
+          throw std::invalid_argument(
+              strutil::cat("Request has unknown value for field: request_encoding  value: ", val));
+        }
+        imp->decoder = Decoders().at(val);
+      }
+    }
+    if (path.empty()) {
+      throw std::invalid_argument("Request missing required field: path");
+    }
+    if (gzip) {
+      imp->gzip = std::make_unique<GzipInflate>();
+    }
+
+    // One writer for the whole upload.
+    imp->writer = std::make_unique<Writer>(File(path));
+    if (imp->standard_headers) {
+      imp->writer->push(add_writer_id_header());
+      imp->writer->push(add_writer_seq_header());
+      imp->writer->push(add_transport_seq_header());
+    }
+  } catch (std::exception& e) {
+    rest_respond(res, "400", {}, e.what());
+    return;
+  }
+
+  res->onData(watched_route([res, imp, failed = false](std::string_view chunk, bool is_end) mutable {
+    if (failed) {
+      // Already answered. Records before the failure were written.
+      return;
+    }
+    try {
+      imp->feed(chunk);
+      if (!is_end) {
+        return;
+      }
+      imp->finish();
+      rest_respond(res, "200", {{"Content-Type", "application/json"}},
+                   strutil::cat("{\"written\":", imp->written, "}"));
+    } catch (std::exception& e) {
+      failed = true;
+      rest_respond(res, "400", {}, strutil::cat(e.what(), "  written: ", imp->written));
+    }
+  }));
+}
+
+}  // namespace a0::api
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <App.h>
+#include <a0.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "a0/api/encoders.hpp"
+#include "a0/api/envelope.hpp"
+#include "a0/api/latest_cache.hpp"
+#include "a0/api/rest_common.hpp"
+#include "a0/api/strutil.hpp"
+#include "a0/api/timers.hpp"
+
+namespace a0::api {
+
+// Requests waiting for a topic to change. Only used within the event loop.
+struct RestLatestPoll {
+  uWS::HttpResponse<false>* res;
+  std::vector<std::string> topics;
+  PayloadEncoder response_encoder;
+  std::string if_none_match;
+  std::optional<Timers::Id> timer;
+};
+
+A0_STATIC_INLINE
+std::unordered_map<uint64_t, RestLatestPoll>& rest_latest_polls() {
+  static std::unordered_map<uint64_t, RestLatestPoll> polls;
+  return polls;
+}
+
+// Responds if any topic changed since if_none_match, or if final.
+// Returns whether it responded.
+A0_STATIC_INLINE
+bool rest_latest_answer(const RestLatestPoll& poll, bool final) {
+  std::vector<LatestCache::Snapshot> snaps;
+  bool filling = false;
+  std::string etag = "\"";
+  for (size_t i = 0; i < poll.topics.size(); i++) {
+    snaps.push_back(LatestCache::get()->lookup(poll.topics[i]));
+    filling |= snaps.back().filling;
+    if (i) {
+      etag += '-';
+    }
+    etag += std::to_string(snaps.back().seq);
+  }
+  etag += '"';
+
+  bool changed = etag != poll.if_none_match;
+  bool missing = poll.topics.size() == 1 && !snaps[0].flat;
+  if (!final && (filling || !changed || missing)) {
+    return false;
+  }
+
+  std::vector<std::pair<std::string, std::string>> headers = {
+      {"ETag", etag},
+      {"Access-Control-Expose-Headers", "ETag"},
+  };
+  if (!changed) {
+    rest_respond(poll.res, "304", std::move(headers), "");
+    return true;
+  }
+  if (missing) {
+    rest_respond(poll.res, "404", {}, "Topic has no packets.");
+    return true;
+  }
+
+  std::string body;
+  if (poll.topics.size() == 1) {
+    write_envelope(snaps[0].fpkt(), "", poll.response_encoder, body);
+  } else {
+    body += '{';
+    for (size_t i = 0; i < poll.topics.size(); i++) {
+      if (i) {
+        body += ',';
+      }
+      body += nlohmann::json(poll.topics[i]).dump();
+      body += ':';
+      if (snaps[i].flat) {
+        write_envelope(snaps[i].fpkt(), "", poll.response_encoder, body);
+      } else {
+        body += "null";
+      }
+    }
+    body += '}';
+  }
+  rest_respond(poll.res, "200", std::move(headers), body);
+  return true;
+}
+
+A0_STATIC_INLINE
+void rest_latest_drop(uint64_t poll_id) {
+  auto it = rest_latest_polls().find(poll_id);
+  if (it == rest_latest_polls().end()) {
+    return;
+  }
+  for (auto&& topic : it->second.topics) {
+    LatestCache::get()->remove_waiter(topic, poll_id);
+  }
+  if (it->second.timer) {
+    Timers::get()->cancel(*it->second.timer);
+  }
+  rest_latest_polls().erase(it);
+}
+
+A0_STATIC_INLINE
+void rest_latest_wake(uint64_t poll_id, bool final) {
+  auto it = rest_latest_polls().find(poll_id);
+  if (it == rest_latest_polls().end()) {
+    return;
+  }
+  bool answered;
+  try {
+    answered = rest_latest_answer(it->second, final);
+  } catch (std::exception& e) {
+    rest_respond(it->second.res, "400", {}, e.what());
+    answered = true;
+  }
+  if (answered) {
+    rest_latest_drop(poll_id);
+  }
+}
+
+// fetch(`http://${api_addr}/api/latest?` + new URLSearchParams([
+//     ["topic", "..."],                 // required, repeat for several topics
+//     ["wait_ms", "0"],                 // optional, wait up to this long for a topic to change
+//     ["response_encoding", "none"],    // optional, one of "none", "base64", "json", "auto"
+// ]), {
+//     headers: {
+//         "If-None-Match": etag,        // optional, the ETag of a previous response
+//     },
+// })
+// .then((r) => { return r.text() })
+// .then((msg) => { console.log(msg) })
+A0_STATIC_INLINE
+void rest_latest(uWS::HttpResponse<false>* res,
+                 uWS::HttpRequest* req) {
+  RestLatestPoll poll;
+  poll.res = res;
+  poll.response_encoder = Encoders().at("");
+  poll.if_none_match = std::string(req->getHeader("if-none-match"));
+  uint64_t wait_ms = 0;
+  bool filling = false;
+
+  try {
+    for (auto&& [key, val] : query_params(req)) {
+      if (key == "topic") {
+        poll.topics.push_back(val);
+      } else if (key == "wait_ms") {
+        try {
+          wait_ms = std::stoull(val);
+        } catch (std::exception& e) {
+          throw std::invalid_argument(
+              strutil::cat("Request field has incorrect format. field: wait_ms  error: ", e.what()));
+        }
+      } else if (key == "response_encoding") {
+        if (!Encoders().count(val)) {
+          throw std::invalid_argument(
+              strutil::cat("Request has unknown value for field: response_encoding  value: ", val));
+        }
+        poll.response_encoder = Encoders().at(val);
+      }
+    }
+    if (poll.topics.empty()) {
+      throw std::invalid_argument("Request missing required field: topic");
+    }
+
+    for (auto&& topic : poll.topics) {
+      filling |= LatestCache::get()->lookup(topic).filling;
+    }
+    if (rest_latest_answer(poll, /* final = */ !wait_ms && !filling)) {
+      return;
+    }
+  } catch (std::exception& e) {
+    rest_respond(res, "400", {}, e.what());
+    return;
+  }
+
+  // Nothing new yet. Wait for a change, or the deadline.
+  static uint64_t next_poll_id = 0;
+  uint64_t poll_id = ++next_poll_id;
+  for (auto&& topic : poll.topics) {
+    LatestCache::get()->add_waiter(topic, poll_id, [poll_id]() { rest_latest_wake(poll_id, false); });
+  }
+  if (filling) {
+    wait_ms = std::max(wait_ms, LatestCache::kFillMs);
+  }
+  poll.timer = Timers::get()->after(wait_ms, [poll_id]() { rest_latest_wake(poll_id, true); });
+  rest_latest_polls()[poll_id] = std::move(poll);
+
+  res->onAborted([poll_id]() { rest_latest_drop(poll_id); });
+}
+
+}  // namespace a0::api
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <App.h>
+#include <a0.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "a0/api/envelope.hpp"
+#include "a0/api/global_state.hpp"
+#include "a0/api/log_query.hpp"
+#include "a0/api/loop_watchdog.hpp"
+#include "a0/api/options.hpp"
+#include "a0/api/request_message.hpp"
+#include "a0/api/rest_common.hpp"
+#include "a0/api/strutil.hpp"
+#include "a0/api/timers.hpp"
+
+namespace a0::api {
+
+// One search: a reader over the log file, from the oldest packet to the
+// newest one at the time the search started.
+// Only used within the event loop, except where noted.
+struct RestLogSearch {
+  // An empty log is given this long to be found.
+  static constexpr uint64_t kFillMs = 100;
+  static constexpr uint64_t kDefaultLimit = 1000;
+  static constexpr uint64_t kDefaultTimeoutMs = 10000;
+
+  uWS::HttpResponse<false>* res;
+  PayloadEncoder response_encoder;
+  LogLevel level;
+  LogQuery query;
+  uint64_t timeout_ms;
+  std::optional<Timers::Id> timer;
+
+  // Guarded by mu. Written from the reader thread.
+  std::mutex mu;
+  std::string matches;
+  uint64_t matched{0};
+  uint64_t scanned{0};
+  std::optional<uint64_t> end_seq;
+  bool complete{false};
+
+  // Declared last, so it stops before the rest is freed.
+  std::unique_ptr<ReaderZeroCopy> reader;
+};
+
+A0_STATIC_INLINE
+std::unordered_map<uint64_t, std::unique_ptr<RestLogSearch>>& rest_log_searches() {
+  static std::unordered_map<uint64_t, std::unique_ptr<RestLogSearch>> searches;
+  return searches;
+}
+
+A0_STATIC_INLINE
+void rest_log_search_finish(uint64_t search_id) {
+  auto it = rest_log_searches().find(search_id);
+  if (it == rest_log_searches().end()) {
+    return;
+  }
+  // Stops the reader on return.
+  auto search = std::move(it->second);
+  rest_log_searches().erase(it);
+  if (search->timer) {
+    Timers::get()->cancel(*search->timer);
+  }
+
+  std::unique_lock<std::mutex> lk{search->mu};
+  // Ends the scan, if the deadline got here first.
+  bool complete = search->complete;
+  search->complete = true;
+  rest_respond(search->res, "200", {{"Content-Type", "application/json"}},
+               strutil::cat("{\"matches\":[", search->matches, "],",
+                            "\"scanned\":", search->scanned, ",",
+                            "\"complete\":", complete ? "true" : "false", "}"));
+}
+
+// Runs on A0 thread. Packets are matched in place; only matches are encoded.
+A0_STATIC_INLINE
+void rest_log_search_scan(RestLogSearch* search, uint64_t search_id,
+                          TransportLocked tlk, FlatPacket fpkt_cpp) {
+  if (!global()->running) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> lk{search->mu};
+  if (search->complete) {
+    return;
+  }
+  uint64_t seq = tlk.frame().hdr.seq;
+  if (!search->end_seq) {
+    // Packets written after the search started aren't part of it.
+    uint64_t seq_high = seq;
+    a0_transport_seq_high(*tlk.c, &seq_high);
+    search->end_seq = seq_high;
+  }
+  search->scanned++;
+
+  a0_flat_packet_t fpkt = *fpkt_cpp.c;
+  bool keep = true;
+  const char* time_wall = nullptr;
+  a0_flat_packet_header_iterator_t iter;
+  a0_packet_header_t hdr;
+  a0_flat_packet_header_iterator_init(&iter, &fpkt);
+  while (keep && a0_flat_packet_header_iterator_next(&iter, &hdr) == A0_OK) {
+    std::string_view key = hdr.key;
+    if (key == "a0_log_level") {
+      auto level = level_map().find(hdr.val);
+      keep = level == level_map().end() || level->second <= search->level;
+    } else if (key == "a0_time_wall") {
+      time_wall = hdr.val;
+    }
+  }
+
+  if (keep && search->query.match_time(time_wall)) {
+    a0_buf_t payload;
+    a0_flat_packet_payload(fpkt, &payload);
+    if (search->query.match_payload(std::string_view((const char*)payload.data, payload.size))) {
+      if (search->matched++) {
+        search->matches.push_back(',');
+      }
+      try {
+        write_envelope(fpkt, strutil::cat("\"seq\":", seq, ","), search->response_encoder, search->matches);
+      } catch (std::exception& e) {
+        search->matches += nlohmann::json({{"error", e.what()}}).dump();
+      }
+    }
+  }
+
+  bool limit_reached = search->query.limit && search->matched >= search->query.limit;
+  if (limit_reached || seq >= *search->end_seq) {
+    search->complete = true;
+    defer("rest_log_search", [search_id]() { rest_log_search_finish(search_id); });
+  }
+}
+
+// fetch(`http://${api_addr}/api/log/search`, {
+//     method: "POST",
+//     body: JSON.stringify({
+//         topic: "...",                     // required
+//         level: "INFO",                    // optional, one of "DBG", "INFO", "WARN", "ERR", "CRIT"
+//         query: {                          // optional, see /wsapi/log
+//             text: "...",
+//             ignore_case: false,
+//             since: "...",
+//             until: "...",
+//             limit: 1000,                  // defaults to 1000. 0 for no limit
+//         },
+//         timeout_ms: 10000,                // optional, return what was found by then
+//         response_encoding: "none",        // optional, one of "none", "base64", "json", "auto"
+//     })
+// })
+// .then((r) => { return r.json() })
+// .then((result) => { console.log(result.matches, result.complete) })
+A0_STATIC_INLINE
+void rest_log_search(uWS::HttpResponse<false>* res,
+                     uWS::HttpRequest* req) {
+  rest_common(res, req, [res](const RequestMessage& req_msg) {
+    // Check required fields.
+    req_msg.require("topic");
+
+    auto search = std::make_unique<RestLogSearch>();
+    search->res = res;
+    search->response_encoder = req_msg.response_encoder;
+    search->level = LogLevel::INFO;
+    req_msg.maybe_option_to("level", level_map(), search->level);
+    search->query.limit = RestLogSearch::kDefaultLimit;
+    if (req_msg.raw_msg.contains("query")) {
+      const auto& query_field = req_msg.raw_msg.at("query");
+      search->query = LogQuery::Parse(query_field);
+      // An explicit 0 is no limit.
+      if (!query_field.contains("limit")) {
+        search->query.limit = RestLogSearch::kDefaultLimit;
+      }
+    }
+    search->timeout_ms = RestLogSearch::kDefaultTimeoutMs;
+    req_msg.maybe_get_to("timeout_ms", search->timeout_ms);
+
+    static uint64_t next_search_id = 0;
+    uint64_t search_id = ++next_search_id;
+    search->reader = std::make_unique<ReaderZeroCopy>(
+        File(topic_path(env::topic_tmpl_log(), req_msg.topic)), INIT_OLDEST, ITER_NEXT,
+        [search = search.get(), search_id](TransportLocked tlk, FlatPacket fpkt) {
+          rest_log_search_scan(search, search_id, tlk, fpkt);
+        });
+
+    // The reader doesn't call back on an empty log. After a short wait, an
+    // empty log is reported as such; otherwise the scan has until the deadline.
+    search->timer = Timers::get()->after(
+        std::min(RestLogSearch::kFillMs, search->timeout_ms), [search_id]() {
+          auto it = rest_log_searches().find(search_id);
+          if (it == rest_log_searches().end()) {
+            return;
+          }
+          auto* search = it->second.get();
+          bool started;
+          {
+            std::unique_lock<std::mutex> lk{search->mu};
+            started = search->scanned > 0;
+            if (!started) {
+              search->complete = true;
+            }
+          }
+          if (!started || search->timeout_ms <= RestLogSearch::kFillMs) {
+            rest_log_search_finish(search_id);
+            return;
+          }
+          search->timer = Timers::get()->after(search->timeout_ms - RestLogSearch::kFillMs, [search_id]() {
+            rest_log_search_finish(search_id);
+          });
+        });
+    rest_log_searches()[search_id] = std::move(search);
+
+    res->onAborted([search_id]() {
+      auto it = rest_log_searches().find(search_id);
+      if (it != rest_log_searches().end()) {
+        if (it->second->timer) {
+          Timers::get()->cancel(*it->second->timer);
+        }
+        rest_log_searches().erase(it);
+      }
+    });
+  });
+}
+
+}  // namespace a0::api
@@ -3,14 +3,52 @@
 #include <App.h>
 #include <a0.h>
 
+#include <memory>
+#include <optional>
 #include <sstream>
+#include <unordered_map>
 
+#include "a0/api/envelope.hpp"
 #include "a0/api/global_state.hpp"
+#include "a0/api/loop_watchdog.hpp"
 #include "a0/api/request_message.hpp"
 #include "a0/api/rest_common.hpp"
+#include "a0/api/rpc_calls.hpp"
+#include "a0/api/timers.hpp"
 
 namespace a0::api {
 
+// Calls awaiting a response. Only used within the event loop.
+struct RestRpcCall {
+  uWS::HttpResponse<false>* res;
+  std::shared_ptr<RpcClient> client;
+  std::string pkt_id;
+  PayloadEncoder response_encoder;
+  std::optional<Timers::Id> timer;
+};
+
+A0_STATIC_INLINE
+std::unordered_map<uint64_t, RestRpcCall>& rest_rpc_calls() {
+  static std::unordered_map<uint64_t, RestRpcCall> calls;
+  return calls;
+}
+
+// Removes the call, so that only the caller answers it.
+A0_STATIC_INLINE
+std::optional<RestRpcCall> rest_rpc_take(uint64_t call_id) {
+  auto it = rest_rpc_calls().find(call_id);
+  if (it == rest_rpc_calls().end()) {
+    return std::nullopt;
+  }
+  auto call = std::move(it->second);
+  rest_rpc_calls().erase(it);
+  RpcCalls::get()->pending--;
+  if (call.timer) {
+    Timers::get()->cancel(*call.timer);
+  }
+  return call;
+}
+
 // fetch(`http://${api_addr}/api/rpc`, {
 //     method: "POST",
 //     body: JSON.stringify({
@@ -23,7 +61,8 @@ namespace a0::api {
 //             payload: "...",               // required
 //         },
 //         request_encoding: "none",         // optional, one of "none", "base64"
-//         response_encoding: "none",        // optional, one of "none", "base64"
+//         response_encoding: "none",        // optional, one of "none", "base64", "json", "auto"
+//         timeout_ms: 30000,                // optional, default set by RPC_TIMEOUT_MS. 0 for no deadline
 //     })
 // })
 // .then((r) => { return r.text() })
@@ -35,28 +74,66 @@ void rest_rpc(uWS::HttpResponse<false>* res,
     // Check required fields.
     req_msg.require("topic");
     req_msg.require(nlohmann::json::json_pointer("/packet/payload"));
+    uint64_t timeout_ms = RpcCalls::get()->default_timeout_ms;
+    req_msg.maybe_get_to("timeout_ms", timeout_ms);
 
     // Perform requested action.
 
-    // rpc_client's lifetime must run until the callback fires.
+    // rpc_client's lifetime must run until the callback fires, or the call is abandoned.
     // The rpc_client CANNOT be freed in the rpc_client's callback.
+    // Only the call table owns it, so nothing outlives an abandoned call.
+    static uint64_t next_call_id = 0;
+    uint64_t call_id = ++next_call_id;
     auto rpc_client = std::make_shared<RpcClient>(req_msg.topic);
 
-    auto callback = [res, req_msg, rpc_client](Packet pkt) {
-      global()->event_loop->defer([res, req_msg, rpc_client, pkt]() {
+    auto& call = rest_rpc_calls()[call_id];
+    call.res = res;
+    call.client = rpc_client;
+    call.pkt_id = std::string(req_msg.pkt.id());
+    call.response_encoder = req_msg.response_encoder;
+    RpcCalls::get()->pending++;
+
+    // The http client gave up. Stop the rpc server working on it, and never touch res again.
+    res->onAborted([call_id]() {
+      if (auto call = rest_rpc_take(call_id)) {
+        RpcCalls::get()->cancelled++;
+        call->client->cancel(call->pkt_id);
+      }
+    });
+
+    if (timeout_ms) {
+      call.timer = Timers::get()->after(timeout_ms, [call_id]() {
+        if (auto call = rest_rpc_take(call_id)) {
+          RpcCalls::get()->timed_out++;
+          call->client->cancel(call->pkt_id);
+          rest_respond(call->res, "504", {}, "Deadline exceeded.");
+        }
+      });
+    }
+
+    auto callback = [call_id](Packet pkt) {
+      defer("rest_rpc", [call_id, pkt]() {
+        auto call = rest_rpc_take(call_id);
+        if (!call) {
+          // Aborted, or past its deadline.
+          return;
+        }
+        RpcCalls::get()->completed++;
         try {
-          rest_respond(res, "200", {}, nlohmann::json{
-                                           {"headers", strutil::flatten(pkt.headers())},
-                                           {"payload", req_msg.response_encoder(pkt.payload())},
-                                       }
-                                           .dump());
+          rest_respond(call->res, "200", {}, envelope(pkt, "", call->response_encoder));
         } catch (std::exception& e) {
-          rest_respond(res, "400", {}, e.what());
+          rest_respond(call->res, "400", {}, e.what());
         }
       });
     };
 
-    rpc_client->send(std::move(req_msg.pkt), callback);
+    try {
+      rpc_client->send(std::move(req_msg.pkt), callback);
+    } catch (...) {
+      // Never sent. Drop the call, and its deadline, before the request is answered with the error.
+      rest_rpc_take(call_id);
+      throw;
+    }
   });
 }
 
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <App.h>
+#include <a0.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "a0/api/envelope.hpp"
+#include "a0/api/global_state.hpp"
+#include "a0/api/loop_watchdog.hpp"
+#include "a0/api/request_message.hpp"
+#include "a0/api/rest_common.hpp"
+#include "a0/api/strutil.hpp"
+#include "a0/api/timers.hpp"
+
+namespace a0::api {
+
+// One snapshot request: a reader per source, and what each has read.
+// Only used within the event loop, except where noted.
+struct RestSnapshot {
+  // Sources with no packets are given this long to be found.
+  static constexpr uint64_t kFillMs = 100;
+
+  struct Source {
+    bool is_topic;
+    std::string name;
+
+    // Guarded by mu. Written once, from the source's reader thread.
+    bool found{false};
+    std::string envelope;
+    std::optional<int64_t> time_mono_ns;
+  };
+
+  uWS::HttpResponse<false>* res;
+  PayloadEncoder response_encoder;
+  std::optional<uint64_t> max_skew_ms;
+  std::optional<Timers::Id> timer;
+
+  std::mutex mu;
+  std::vector<Source> sources;
+  size_t remaining;
+
+  // Declared last, so they stop before the rest is freed.
+  std::vector<std::unique_ptr<ReaderZeroCopy>> readers;
+  std::vector<std::unique_ptr<SubscriberZeroCopy>> subs;
+};
+
+A0_STATIC_INLINE
+std::unordered_map<uint64_t, std::unique_ptr<RestSnapshot>>& rest_snapshots() {
+  static std::unordered_map<uint64_t, std::unique_ptr<RestSnapshot>> snapshots;
+  return snapshots;
+}
+
+A0_STATIC_INLINE
+void rest_snapshot_finish(uint64_t snapshot_id) {
+  auto it = rest_snapshots().find(snapshot_id);
+  if (it == rest_snapshots().end()) {
+    return;
+  }
+  // Stops the readers on return.
+  auto snapshot = std::move(it->second);
+  rest_snapshots().erase(it);
+  if (snapshot->timer) {
+    Timers::get()->cancel(*snapshot->timer);
+  }
+
+  std::unique_lock<std::mutex> lk{snapshot->mu};
+
+  std::optional<int64_t> min_ns;
+  std::optional<int64_t> max_ns;
+  for (auto&& src : snapshot->sources) {
+    if (src.time_mono_ns) {
+      min_ns = std::min(min_ns.value_or(*src.time_mono_ns), *src.time_mono_ns);
+      max_ns = std::max(max_ns.value_or(*src.time_mono_ns), *src.time_mono_ns);
+    }
+  }
+  double skew_ms = min_ns ? (*max_ns - *min_ns) / 1e6 : 0;
+  if (snapshot->max_skew_ms && skew_ms > *snapshot->max_skew_ms) {
+    rest_respond(snapshot->res, "409", {},
+                 strutil::cat("Snapshot skew exceeds max_skew_ms. skew_ms: ", skew_ms));
+    return;
+  }
+
+  // Sources are few, so the object keys are written in request order.
+  std::string topics_body;
+  std::string paths_body;
+  for (auto&& src : snapshot->sources) {
+    auto& body = src.is_topic ? topics_body : paths_body;
+    body += body.empty() ? '{' : ',';
+    body += nlohmann::json(src.name).dump();
+    body += ':';
+    body += src.found ? src.envelope : "null";
+  }
+
+  std::string out = "{";
+  if (!topics_body.empty()) {
+    out += "\"topics\":" + topics_body + "},";
+  }
+  if (!paths_body.empty()) {
+    out += "\"paths\":" + paths_body + "},";
+  }
+  out += strutil::cat("\"skew_ms\":", nlohmann::json(skew_ms).dump(), "}");
+  rest_respond(snapshot->res, "200", {}, out);
+}
+
+// Runs on A0 thread.
+A0_STATIC_INLINE
+void rest_snapshot_record(RestSnapshot* snapshot, uint64_t snapshot_id, size_t idx,
+                          TransportLocked tlk, FlatPacket fpkt_cpp) {
+  if (!global()->running) {
+    return;
+  }
+
+  a0_flat_packet_t fpkt = *fpkt_cpp.c;
+  std::optional<int64_t> time_mono_ns;
+  std::string time_fields;
+  a0_flat_packet_header_iterator_t iter;
+  a0_packet_header_t hdr;
+  a0_flat_packet_header_iterator_init(&iter, &fpkt);
+  while (a0_flat_packet_header_iterator_next(&iter, &hdr) == A0_OK) {
+    std::string_view key = hdr.key;
+    if (key == "a0_time_mono") {
+      a0_time_mono_t mono;
+      if (a0_time_mono_parse(hdr.val, &mono) == A0_OK) {
+        time_mono_ns = int64_t(mono.ts.tv_sec) * 1000000000 + mono.ts.tv_nsec;
+      }
+      time_fields += strutil::cat("\"time_mono\":", nlohmann::json(hdr.val).dump(), ",");
+    } else if (key == "a0_time_wall") {
+      time_fields += strutil::cat("\"time_wall\":", nlohmann::json(hdr.val).dump(), ",");
+    }
+  }
+
+  std::string envelope;
+  std::string fields = strutil::cat("\"seq\":", tlk.frame().hdr.seq, ",", time_fields);
+  try {
+    write_envelope(fpkt, fields, snapshot->response_encoder, envelope);
+  } catch (std::exception& e) {
+    envelope = nlohmann::json({{"error", e.what()}}).dump();
+  }
+
+  std::unique_lock<std::mutex> lk{snapshot->mu};
+  auto& src = snapshot->sources[idx];
+  if (src.found) {
+    // Only the first packet is part of the snapshot.
+    return;
+  }
+  src.found = true;
+  src.envelope = std::move(envelope);
+  src.time_mono_ns = time_mono_ns;
+  if (--snapshot->remaining == 0) {
+    defer("rest_snapshot", [snapshot_id]() { rest_snapshot_finish(snapshot_id); });
+  }
+}
+
+// fetch(`http://${api_addr}/api/snapshot`, {
+//     method: "POST",
+//     body: JSON.stringify({
+//         topics: ["...", ...],             // optional, pubsub topics
+//         paths: ["...", ...],              // optional, files. At least one topic or path is required
+//         response_encoding: "none",        // optional, one of "none", "base64", "json", "auto"
+//         max_skew_ms: 100,                 // optional, fail if a0_time_mono headers differ by more
+//     })
+// })
+// .then((r) => { return r.json() })
+// .then((snapshot) => { console.log(snapshot) })
+A0_STATIC_INLINE
+void rest_snapshot(uWS::HttpResponse<false>* res,
+                   uWS::HttpRequest* req) {
+  rest_common(res, req, [res](const RequestMessage& req_msg) {
+    auto snapshot = std::make_unique<RestSnapshot>();
+    snapshot->res = res;
+    snapshot->response_encoder = req_msg.response_encoder;
+    if (req_msg.raw_msg.contains("max_skew_ms")) {
+      snapshot->max_skew_ms = req_msg.require_get<uint64_t>("max_skew_ms");
+    }
+
+    // Each source is read once, even if requested twice.
+    std::map<std::pair<bool, std::string>, size_t> seen;
+    auto add_sources = [&](const char* field, bool is_topic) {
+      for (auto&& name : req_msg.maybe_get<std::vector<std::string>>(field)) {
+        if (seen.emplace(std::make_pair(is_topic, name), snapshot->sources.size()).second) {
+          snapshot->sources.push_back({is_topic, name});
+        }
+      }
+    };
+    add_sources("topics", true);
+    add_sources("paths", false);
+    if (snapshot->sources.empty()) {
+      throw std::invalid_argument("Request missing required field: topics");
+    }
+    snapshot->remaining = snapshot->sources.size();
+
+    // Each reader has its own thread, so the sources are read in parallel.
+    static uint64_t next_snapshot_id = 0;
+    uint64_t snapshot_id = ++next_snapshot_id;
+    for (size_t i = 0; i < snapshot->sources.size(); i++) {
+      auto cb = [snapshot = snapshot.get(), snapshot_id, i](TransportLocked tlk, FlatPacket fpkt) {
+        rest_snapshot_record(snapshot, snapshot_id, i, tlk, fpkt);
+      };
+      auto& src = snapshot->sources[i];
+      if (src.is_topic) {
+        snapshot->subs.push_back(
+            std::make_unique<SubscriberZeroCopy>(src.name, INIT_MOST_RECENT, ITER_NEWEST, cb));
+      } else {
+        snapshot->readers.push_back(
+            std::make_unique<ReaderZeroCopy>(File(src.name), INIT_MOST_RECENT, ITER_NEWEST, cb));
+      }
+    }
+
+    snapshot->timer = Timers::get()->after(RestSnapshot::kFillMs, [snapshot_id]() {
+      rest_snapshot_finish(snapshot_id);
+    });
+    rest_snapshots()[snapshot_id] = std::move(snapshot);
+
+    res->onAborted([snapshot_id]() {
+      auto it = rest_snapshots().find(snapshot_id);
+      if (it != rest_snapshots().end()) {
+        if (it->second->timer) {
+          Timers::get()->cancel(*it->second->timer);
+        }
+        rest_snapshots().erase(it);
+      }
+    });
+  });
+}
+
+}  // namespace a0::api
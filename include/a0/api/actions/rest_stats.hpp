@@ -0,0 +1,40 @@
+#pragma once
+
+#include <App.h>
+#include <a0.h>
+#include <nlohmann/json.hpp>
+
+#include "a0/api/buffer_pool.hpp"
+#include "a0/api/latest_cache.hpp"
+#include "a0/api/loop_watchdog.hpp"
+#include "a0/api/outbound_budget.hpp"
+#include "a0/api/rest_common.hpp"
+#include "a0/api/rpc_calls.hpp"
+#include "a0/api/ws_outbox.hpp"
+
+namespace a0::api {
+
+// fetch(`http://${api_addr}/api/stats`)
+// .then((r) => { return r.json() })
+// .then((stats) => { console.log(stats) })
+A0_STATIC_INLINE
+void rest_stats(uWS::HttpResponse<false>* res,
+                uWS::HttpRequest* req) {
+  rest_respond(res, "200", {}, nlohmann::json({
+                                                  {"connections",
+                                                   {
+                                                       {"active", global()->active_ws.size()},
+                                                       {"slots", global()->active_ws.capacity()},
+                                                       {"opened", global()->active_ws.opened()},
+                                                   }},
+                                                  {"send_queue", WSOutbox::get()->stats()},
+                                                  {"buffer_pool", BufferPool::stats()},
+                                                  {"outbound", OutboundBudget::get()->stats()},
+                                                  {"rpc", RpcCalls::get()->stats()},
+                                                  {"latest", LatestCache::get()->stats()},
+                                                  {"loop", LoopWatchdog::get()->stats()},
+                                              })
+                                   .dump());
+}
+
+}  // namespace a0::api
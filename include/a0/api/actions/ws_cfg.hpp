@@ -0,0 +1,143 @@
+#pragma once
+
+#include <App.h>
+#include <nlohmann/json.hpp>
+
+#include <memory>
+#include <optional>
+
+#include "a0/api/options.hpp"
+#include "a0/api/strutil.hpp"
+#include "a0/api/ws_common.hpp"
+
+namespace a0::api {
+
+// ws = new WebSocket(`ws://${api_addr}/wsapi/cfg`)
+// ws.onopen = () => {
+//     ws.send(JSON.stringify({
+//         topic: "...",                 // required
+//         path: "/json/pointer",        // optional, defaults to the whole document
+//         scheduler: "ON_DRAIN",        // optional, one of "IMMEDIATE", "ON_ACK", "ON_DRAIN"
+//         backpressure: "THROTTLE",     // optional, one of "THROTTLE", "SHED"
+//     }))
+// }
+// ws.onmessage = (evt) => {
+//     ... JSON.parse(evt.data).value ...    // first message, the current value at path
+//     ... JSON.parse(evt.data).patch ...    // then, RFC 6902 patches to it
+// }
+struct WSCfg {
+  // Access and edit only in uWS thread.
+  // Owns A0 thread.
+  struct Data {
+    std::shared_ptr<WSCommon> ws_common;
+    std::unique_ptr<CfgWatcher> watcher;
+  };
+
+  struct AlephZeroCallback {
+    std::shared_ptr<WSCommon> ws_common;
+    nlohmann::json::json_pointer ptr;
+    std::function<void(std::string)> send;
+    std::function<void(int, std::string)> end;
+    // The value at ptr, as last sent. Only used on the A0 thread.
+    std::optional<nlohmann::json> last;
+
+    // Runs on uWS thread.
+    template <typename WebSocket>
+    AlephZeroCallback(WebSocket* ws, nlohmann::json::json_pointer ptr_)
+        : ws_common{ws->getUserData()->ws_common},
+          ptr{std::move(ptr_)},
+          send{ws_common->bind_send(ws)},
+          end{ws_common->bind_end(ws)} {}
+
+    // Runs on A0 thread.
+    void operator()(Packet pkt) {
+      if (!global()->running) {
+        return;
+      }
+
+      auto doc = nlohmann::json::parse(pkt.payload(), nullptr, false);
+      if (doc.is_discarded()) {
+        end(1011, "Cfg is not json.");
+        return;
+      }
+      nlohmann::json value = doc.contains(ptr) ? std::move(doc.at(ptr)) : nullptr;
+
+      // The diff is computed here, once, so the client only handles what changed.
+      std::string to_send;
+      if (!last) {
+        to_send = nlohmann::json({{"value", value}}).dump();
+      } else {
+        auto patch = nlohmann::json::diff(*last, value);
+        if (patch.empty()) {
+          // Another part of the document changed.
+          return;
+        }
+        to_send = nlohmann::json({{"patch", std::move(patch)}}).dump();
+      }
+      last = std::move(value);
+
+      // Save the event count before sending the message.
+      // Depending on the scheduler, the watcher might block until the event counter increments.
+      int64_t pre_send_cnt = ws_common->wake_cnt;
+
+      send(std::move(to_send));
+
+      ws_common->wait(pre_send_cnt);
+    }
+  };
+
+  static uWS::App::WebSocketBehavior<Data> behavior() {
+    return {
+        .compression = uWS::SHARED_COMPRESSOR,
+        .maxPayloadLength = 16 * 1024 * 1024,
+        .idleTimeout = 0,
+        .maxBackpressure = 16 * 1024 * 1024,
+        .closeOnBackpressureLimit = false,
+        .resetIdleTimeoutOnSend = true,
+        .upgrade = nullptr,
+        .open = [](auto* ws) { WSCommon::onopen(ws); },
+        .message =
+            [](auto* ws, std::string_view msg, uWS::OpCode code) {
+              auto* data = ws->getUserData();
+              data->ws_common->OnMessageWithHandshake(
+                  ws, msg, code, [ws, data](const RequestMessage& req_msg) {
+                    req_msg.require("topic");
+                    // A dropped patch would break the ones after it.
+                    if (data->ws_common->outbound.policy == backpressure_t::CONFLATE) {
+                      throw std::invalid_argument("Option backpressure CONFLATE isn't supported for cfg.");
+                    }
+                    std::string path;
+                    req_msg.maybe_get_to("path", path);
+                    nlohmann::json::json_pointer ptr;
+                    try {
+                      ptr = nlohmann::json::json_pointer(path);
+                    } catch (std::exception& e) {
+                      throw std::invalid_argument(
+                          strutil::cat("Request field has incorrect format. field: path  error: ", e.what()));
+                    }
+                    data->watcher = std::make_unique<CfgWatcher>(
+                        req_msg.topic,
+                        std::function<void(Packet)>(AlephZeroCallback(ws, std::move(ptr))));
+                  });
+            },
+        .drain =
+            [](auto* ws) {
+              auto* data = ws->getUserData();
+              if (data->ws_common) {
+                data->ws_common->ondrain(ws);
+              }
+            },
+        .ping = nullptr,
+        .pong = nullptr,
+        .close =
+            [](auto* ws, int code, std::string_view msg) {
+              auto* data = ws->getUserData();
+              if (data->ws_common) {
+                data->ws_common->onclose(ws);
+              }
+            },
+    };
+  }
+};
+
+}  // namespace a0::api
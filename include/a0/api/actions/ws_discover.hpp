@@ -16,6 +16,7 @@ namespace a0::api {
 //         protocol: "file",             // optional, one of "file", "pubsub", "rpc", "prpc", "log", "cfg"
 //         topic: "**/*",                // optional
 //         scheduler: "ON_DRAIN",        // optional, one of "IMMEDIATE", "ON_ACK", "ON_DRAIN"
+//         backpressure: "THROTTLE",     // optional, one of "THROTTLE", "CONFLATE", "SHED"
 //     }))
 // }
 // ws.onmessage = (evt) => {
@@ -79,13 +80,10 @@ struct WSDiscover {
         .closeOnBackpressureLimit = false,
         .resetIdleTimeoutOnSend = true,
         .upgrade = nullptr,
-        .open = [](auto* ws) { global()->active_ws.insert(ws); },
+        .open = [](auto* ws) { WSCommon::onopen(ws); },
         .message =
             [](auto* ws, std::string_view msg, uWS::OpCode code) {
               auto* data = ws->getUserData();
-              if (!data->ws_common) {
-                data->ws_common = std::make_shared<WSCommon>();
-              }
               data->ws_common->OnMessageWithHandshake(
                   ws, msg, code, [ws, data](const RequestMessage& req_msg) {
                     req_msg.require("protocol");
@@ -2,8 +2,13 @@
 
 #include <App.h>
 
+#include <charconv>
+#include <cstdint>
 #include <memory>
+#include <optional>
 
+#include "a0/api/envelope.hpp"
+#include "a0/api/log_query.hpp"
 #include "a0/api/options.hpp"
 #include "a0/api/ws_common.hpp"
 
@@ -16,8 +21,11 @@ namespace a0::api {
 //         level: "INFO",                // optional, one of "DBG", "INFO", "WARN", "ERR", "CRIT"
 //         init: "AWAIT_NEW",            // optional, one of "OLDEST", "MOST_RECENT", "AWAIT_NEW"
 //         iter: "NEXT",                 // optional, one of "NEXT", "NEWEST"
-//         response_encoding: "none",    // optional, one of "none", "base64"
+//         response_encoding: "none",    // optional, one of "none", "base64", "json", "auto"
 //         scheduler: "ON_DRAIN",        // optional, one of "IMMEDIATE", "ON_ACK", "ON_DRAIN"
+//         backpressure: "THROTTLE",     // optional, one of "THROTTLE", "CONFLATE", "SHED"
+//         filter: null,                 // optional, header predicate. ex: {key: "source", eq: "lidar_front"}
+//         query: null,                  // optional, payload search. ex: {text: "timeout", ignore_case: true, limit: 100}
 //     }))
 // }
 // ws.onmessage = (evt) => {
@@ -31,15 +39,30 @@ struct WSLog {
 
   struct AlephZeroCallback {
     std::shared_ptr<WSCommon> ws_common;
-    std::function<std::string(std::string_view)> response_encoder;
+    PayloadEncoder response_encoder;
+    std::optional<LogQuery> query;
     std::function<void(std::string)> send;
+    std::function<void(int, std::string)> end;
+    // Only used on the A0 thread.
+    uint64_t matched{0};
 
     // Runs on uWS thread.
     template <typename WebSocket>
     AlephZeroCallback(WebSocket* ws, const RequestMessage& req_msg)
-        : ws_common{ws->getUserData()->ws_common},
+        : AlephZeroCallback(ws, ws->getUserData()->ws_common, req_msg) {}
+
+    // Runs on uWS thread. Sends as the given ws_common, ex: a channel of a multiplexed websocket.
+    template <typename WebSocket>
+    AlephZeroCallback(WebSocket* ws, std::shared_ptr<WSCommon> ws_common_, const RequestMessage& req_msg)
+        : ws_common{std::move(ws_common_)},
           response_encoder{req_msg.response_encoder},
-          send{ws_common->bind_send(ws)} {}
+          send{ws_common->bind_send(ws)},
+          end{ws_common->bind_end(ws)} {
+      auto query_field = req_msg.raw_msg.find("query");
+      if (query_field != req_msg.raw_msg.end() && !query_field->is_null()) {
+        query = LogQuery::Parse(*query_field);
+      }
+    }
 
     // Runs on A0 thread.
     void operator()(Packet pkt) {
@@ -47,20 +70,46 @@ struct WSLog {
         return;
       }
 
-      // TODO: Should we handle reader_seq_min here?
+      if (query && query->limit && matched >= query->limit) {
+        return;
+      }
+
+      const char* time_wall = nullptr;
+      for (auto&& [key, val] : pkt.headers()) {
+        if (key == "a0_transport_seq" && ws_common->reader_seq_min) {
+          // A malformed header lets the packet through, rather than throwing on the A0 thread.
+          uint64_t seq = 0;
+          auto [end, err] = std::from_chars(val.data(), val.data() + val.size(), seq);
+          if (err == std::errc() && end == val.data() + val.size() && seq <= ws_common->reader_seq_min) {
+            return;
+          }
+        } else if (key == "a0_time_wall") {
+          time_wall = val.c_str();
+        }
+      }
+
+      if (ws_common->filter && !ws_common->filter->match(pkt)) {
+        return;
+      }
+
+      // Tested before encoding, so only matches are copied out.
+      if (query && (!query->match_time(time_wall) || !query->match_payload(pkt.payload()))) {
+        return;
+      }
 
-      auto headers = strutil::flatten(pkt.headers());
-      auto payload = response_encoder(pkt.payload());
+      std::string to_send = ws_common->pool.acquire(envelope_size_hint(pkt.payload().size()));
+      write_envelope(pkt, ws_common->envelope_fields, response_encoder, to_send);
 
       // Save the event count before sending the message.
       // Depending on the scheduler, the log listener might block until the event counter increments.
       int64_t pre_send_cnt = ws_common->wake_cnt;
 
-      send(nlohmann::json({
-                              {"headers", headers},
-                              {"payload", payload},
-                          })
-               .dump());
+      send(std::move(to_send));
+
+      if (query && query->limit && ++matched == query->limit) {
+        end(1000, "Query limit reached.");
+        return;
+      }
 
       ws_common->wait(pre_send_cnt);
     }
@@ -75,13 +124,10 @@ struct WSLog {
         .closeOnBackpressureLimit = false,
         .resetIdleTimeoutOnSend = true,
         .upgrade = nullptr,
-        .open = [](auto* ws) { global()->active_ws.insert(ws); },
+        .open = [](auto* ws) { WSCommon::onopen(ws); },
         .message =
             [](auto* ws, std::string_view msg, uWS::OpCode code) {
               auto* data = ws->getUserData();
-              if (!data->ws_common) {
-                data->ws_common = std::make_shared<WSCommon>();
-              }
               data->ws_common->OnMessageWithHandshake(
                   ws, msg, code, [ws, data](const RequestMessage& req_msg) {
                     req_msg.require("topic");
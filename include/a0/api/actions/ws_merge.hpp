@@ -0,0 +1,228 @@
+#pragma once
+
+#include <App.h>
+#include <a0.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "a0/api/envelope.hpp"
+#include "a0/api/merge_buffer.hpp"
+#include "a0/api/options.hpp"
+#include "a0/api/scope.hpp"
+#include "a0/api/strutil.hpp"
+#include "a0/api/timers.hpp"
+#include "a0/api/ws_common.hpp"
+
+namespace a0::api {
+
+// ws = new WebSocket(`ws://${api_addr}/wsapi/merge`)
+// ws.onopen = () => {
+//     ws.send(JSON.stringify({
+//         topics: ["...", ...],         // required
+//         mode: "ordered",              // optional, one of "ordered", "sync"
+//         window_ms: 100,               // optional, ordered. How long to wait for a quiet topic
+//         tolerance_ms: 10,             // optional, sync. Largest a0_time_mono spread within a tuple
+//         max_buffer: 1024,             // optional, frames held back for reordering
+//         init: "AWAIT_NEW",            // optional, one of "OLDEST", "MOST_RECENT", "AWAIT_NEW"
+//         iter: "NEXT",                 // optional, one of "NEXT", "NEWEST"
+//         response_encoding: "none",    // optional, one of "none", "base64", "json", "auto"
+//         scheduler: "ON_DRAIN",        // optional, one of "IMMEDIATE", "ON_ACK", "ON_DRAIN"
+//         backpressure: "THROTTLE",     // optional, one of "THROTTLE", "CONFLATE", "SHED"
+//         filter: null,                 // optional, header predicate. ex: {key: "source", eq: "lidar_front"}
+//     }))
+// }
+// ws.onmessage = (evt) => {
+//     ... JSON.parse(evt.data).topic ...     // ordered
+//     ... JSON.parse(evt.data).topics ...    // sync
+// }
+struct WSMerge {
+  // Access and edit only in uWS thread.
+  // Owns A0 threads.
+  struct Data {
+    std::shared_ptr<WSCommon> ws_common;
+    std::shared_ptr<MergeBuffer> merge;
+    std::optional<Timers::Id> tick;
+    std::vector<std::unique_ptr<SubscriberZeroCopy>> subs;
+  };
+
+  static int64_t mono_now_ns() {
+    a0_time_mono_t now;
+    a0_time_mono_now(&now);
+    return int64_t(now.ts.tv_sec) * 1000000000 + now.ts.tv_nsec;
+  }
+
+  // Like WSRead's, but frames go to the merge buffer, and the scheduler only
+  // waits when the push merged something.
+  struct AlephZeroCallback {
+    std::shared_ptr<WSCommon> ws_common;
+    std::shared_ptr<MergeBuffer> merge;
+    size_t idx;
+    PayloadEncoder response_encoder;
+    std::string envelope_fields;
+    std::function<void(int, std::string)> end;
+
+    // Runs on A0 thread.
+    void operator()(TransportLocked tlk, FlatPacket fpkt_cpp) {
+      if (!global()->running) {
+        return;
+      }
+      if (tlk.frame().hdr.seq <= ws_common->reader_seq_min) {
+        return;
+      }
+      if (ws_common->filter && !ws_common->filter->match(*fpkt_cpp.c)) {
+        return;
+      }
+
+      a0_flat_packet_t fpkt = *fpkt_cpp.c;
+      int64_t now_ns = mono_now_ns();
+      // Packets without the header are placed by arrival.
+      int64_t time_ns = now_ns;
+      a0_flat_packet_header_iterator_t iter;
+      a0_packet_header_t hdr;
+      a0_flat_packet_header_iterator_init(&iter, &fpkt);
+      while (a0_flat_packet_header_iterator_next(&iter, &hdr) == A0_OK) {
+        if (std::string_view(hdr.key) == "a0_time_mono") {
+          a0_time_mono_t mono;
+          if (a0_time_mono_parse(hdr.val, &mono) == A0_OK) {
+            time_ns = int64_t(mono.ts.tv_sec) * 1000000000 + mono.ts.tv_nsec;
+          }
+          break;
+        }
+      }
+
+      std::string frame = ws_common->pool.acquire(envelope_size_hint(fpkt.buf.size));
+      try {
+        write_envelope(fpkt, envelope_fields, response_encoder, frame);
+      } catch (std::exception& ex) {
+        end(1011, ex.what());
+        return;
+      }
+
+      // Unlock the transport. It needs to be relocked before the function returns.
+      auto eos_relock_transport = scope_unlock_transport(*tlk.c);
+
+      // Save the event count before sending the message.
+      // Depending on the scheduler, the subscriber might block until the event counter increments.
+      int64_t pre_send_cnt = ws_common->wake_cnt;
+
+      if (merge->push(idx, {time_ns, std::move(frame)}, now_ns)) {
+        ws_common->wait(pre_send_cnt);
+      }
+    }
+  };
+
+  // Sends ordered frames that waited out the window, while no packets arrive.
+  template <typename WebSocket>
+  static void schedule_tick(WebSocket* ws) {
+    auto* data = ws->getUserData();
+    uint64_t ms = std::max<int64_t>(1, data->merge->window_ns / 2000000);
+    data->tick = Timers::get()->after(ms, [ws_common = data->ws_common]() {
+      auto* ws = ws_common->socket<WebSocket>();
+      if (!ws) {
+        return;
+      }
+      auto* data = ws->getUserData();
+      data->tick.reset();
+      data->merge->tick(mono_now_ns());
+      schedule_tick(ws);
+    });
+  }
+
+  static uWS::App::WebSocketBehavior<Data> behavior() {
+    return {
+        .compression = uWS::SHARED_COMPRESSOR,
+        .maxPayloadLength = 16 * 1024 * 1024,
+        .idleTimeout = 0,
+        .maxBackpressure = 16 * 1024 * 1024,
+        .closeOnBackpressureLimit = false,
+        .resetIdleTimeoutOnSend = true,
+        .upgrade = nullptr,
+        .open = [](auto* ws) { WSCommon::onopen(ws); },
+        .message =
+            [](auto* ws, std::string_view msg, uWS::OpCode code) {
+              auto* data = ws->getUserData();
+              data->ws_common->OnMessageWithHandshake(
+                  ws, msg, code, [ws, data](const RequestMessage& req_msg) {
+                    auto& ws_common = data->ws_common;
+                    auto topics = req_msg.require_get<std::vector<std::string>>("topics");
+                    if (topics.empty()) {
+                      throw std::invalid_argument("Request missing required field: topics");
+                    }
+                    if (std::set<std::string>(topics.begin(), topics.end()).size() != topics.size()) {
+                      throw std::invalid_argument("Request has duplicate topics.");
+                    }
+                    // One delta state can't follow several topics.
+                    if (ws_common->delta) {
+                      throw std::invalid_argument("Option delta isn't supported for merge.");
+                    }
+
+                    auto merge = std::make_shared<MergeBuffer>();
+                    std::string mode = "ordered";
+                    req_msg.maybe_get_to("mode", mode);
+                    if (mode == "ordered") {
+                      merge->mode = MergeBuffer::Mode::ORDERED;
+                    } else if (mode == "sync") {
+                      merge->mode = MergeBuffer::Mode::SYNC;
+                    } else {
+                      throw std::invalid_argument(strutil::cat("Request has unknown value for field: mode  value: ", mode));
+                    }
+                    uint64_t window_ms = 100;
+                    uint64_t tolerance_ms = 10;
+                    uint64_t max_buffer = 1024;
+                    req_msg.maybe_get_to("window_ms", window_ms);
+                    req_msg.maybe_get_to("tolerance_ms", tolerance_ms);
+                    req_msg.maybe_get_to("max_buffer", max_buffer);
+                    merge->window_ns = int64_t(window_ms) * 1000000;
+                    merge->tolerance_ns = int64_t(tolerance_ms) * 1000000;
+                    merge->max_buffer = std::max<uint64_t>(max_buffer, 1);
+                    merge->init(topics);
+                    merge->send = ws_common->bind_send(ws);
+                    merge->release = [ws_common](std::string frame) { ws_common->pool.release(std::move(frame)); };
+                    data->merge = merge;
+
+                    auto response_encoder = ws_common->payload_encoder(req_msg.response_encoder);
+                    for (size_t i = 0; i < topics.size(); i++) {
+                      std::string fields = ws_common->envelope_fields;
+                      if (merge->mode == MergeBuffer::Mode::ORDERED) {
+                        fields += strutil::cat("\"topic\":", nlohmann::json(topics[i]).dump(), ",");
+                      }
+                      data->subs.push_back(std::make_unique<SubscriberZeroCopy>(
+                          topics[i], ws_common->reader_init, ws_common->reader_iter,
+                          AlephZeroCallback{ws_common, merge, i, response_encoder, fields, ws_common->bind_end(ws)}));
+                    }
+
+                    if (merge->mode == MergeBuffer::Mode::ORDERED) {
+                      schedule_tick(ws);
+                    }
+                  });
+            },
+        .drain =
+            [](auto* ws) {
+              auto* data = ws->getUserData();
+              if (data->ws_common) {
+                data->ws_common->ondrain(ws);
+              }
+            },
+        .ping = nullptr,
+        .pong = nullptr,
+        .close =
+            [](auto* ws, int code, std::string_view msg) {
+              auto* data = ws->getUserData();
+              if (data->tick) {
+                Timers::get()->cancel(*data->tick);
+              }
+              if (data->ws_common) {
+                data->ws_common->onclose(ws);
+              }
+            },
+    };
+  }
+};
+
+}  // namespace a0::api
@@ -0,0 +1,313 @@
+#pragma once
+
+#include <App.h>
+#include <a0.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "a0/api/actions/ws_log.hpp"
+#include "a0/api/actions/ws_prpc.hpp"
+#include "a0/api/actions/ws_read.hpp"
+#include "a0/api/options.hpp"
+#include "a0/api/strutil.hpp"
+#include "a0/api/ws_common.hpp"
+
+namespace a0::api {
+
+// ws = new WebSocket(`ws://${api_addr}/wsapi/mux`)
+// ws.onopen = () => {
+//     ws.send(JSON.stringify({
+//         cmd: "subscribe",             // required, one of "subscribe", "read", "log", "prpc", "unsubscribe", "ack", "full"
+//         channel: 1,                   // required, integer chosen by the client
+//         ...                           // options of the matching endpoint
+//     }))
+// }
+// ws.onmessage = (evt) => {
+//     ... JSON.parse(evt.data).channel ...
+// }
+struct WSMux {
+  // Channels take turns writing a frame, while the socket has less than this buffered.
+  static constexpr size_t kHighWater = 256 * 1024;
+
+  // Access and edit only in uWS thread.
+  struct Channel {
+    std::shared_ptr<WSCommon> ws_common;
+    // Frames handed over by the A0 thread, waiting for their turn.
+    std::deque<std::string> ready;
+
+    // One of the following is set, depending on cmd.
+    std::unique_ptr<ReaderZeroCopy> reader;
+    std::unique_ptr<SubscriberZeroCopy> sub;
+    std::unique_ptr<LogListener> listener;
+    // Declared before the client, so the client stops first.
+    std::unique_ptr<WSPrpc::AlephZeroCallback> prpc_callback;
+    std::unique_ptr<PrpcClient> prpc_client;
+    std::string prpc_connection_id;
+  };
+
+  // Access and edit only in uWS thread.
+  // Owns A0 threads.
+  struct Data {
+    std::shared_ptr<WSCommon> ws_common;
+    std::map<int64_t, std::unique_ptr<Channel>> channels;
+    // Channels with ready frames, in the order they get their turn.
+    std::deque<int64_t> turns;
+  };
+
+  template <typename WebSocket>
+  static void send_error(WebSocket* ws, const nlohmann::json& channel, std::string_view err) {
+    ws->send(nlohmann::json({{"channel", channel}, {"error", std::string(err)}}).dump(), uWS::TEXT, true);
+  }
+
+  // Stops the channel sending, and releases the frames it still has queued.
+  static void stop(Channel& ch) {
+    ch.ws_common->wake_hook = nullptr;
+    ch.ws_common->finish();
+    if (ch.prpc_client) {
+      ch.prpc_client->cancel(ch.prpc_connection_id);
+    }
+    for (auto& frame : ch.ready) {
+      OutboundBudget::get()->sub_queued(ch.ws_common->outbound, frame.size());
+      ch.ws_common->pool.release(std::move(frame));
+    }
+    ch.ready.clear();
+  }
+
+  // If err is not empty, the client is told why the channel closed.
+  // If ws_common is given, the channel is only closed if it is still the one open under id.
+  template <typename WebSocket>
+  static void close_channel(Data* data, int64_t id, std::string_view err, WSCommon* ws_common = nullptr) {
+    auto it = data->channels.find(id);
+    if (it == data->channels.end() || (ws_common && it->second->ws_common.get() != ws_common)) {
+      return;
+    }
+    auto ch = std::move(it->second);
+    data->channels.erase(it);
+    data->turns.erase(std::remove(data->turns.begin(), data->turns.end(), id), data->turns.end());
+
+    stop(*ch);
+    if (!err.empty()) {
+      if (auto* ws = data->ws_common->socket<WebSocket>()) {
+        send_error(ws, id, err);
+      }
+    }
+    // Destroying the channel joins its A0 thread.
+  }
+
+  // Runs on the event loop, in place of WSCommon writing the frame itself.
+  template <typename WebSocket>
+  static void deliver(Data* data, int64_t id, WSCommon* ws_common, std::string frame) {
+    auto it = data->channels.find(id);
+    if (it == data->channels.end() || it->second->ws_common.get() != ws_common) {
+      // The channel closed while the frame was queued.
+      OutboundBudget::get()->sub_queued(ws_common->outbound, frame.size());
+      ws_common->pool.release(std::move(frame));
+      return;
+    }
+
+    auto& ch = *it->second;
+    if (ch.ready.empty()) {
+      data->turns.push_back(id);
+    }
+    ch.ready.push_back(std::move(frame));
+    pump<WebSocket>(data);
+  }
+
+  // Writes ready frames round robin across channels, so a busy channel can't starve the rest.
+  template <typename WebSocket>
+  static void pump(Data* data) {
+    auto* ws = data->ws_common->socket<WebSocket>();
+    if (!ws) {
+      return;
+    }
+    auto* budget = OutboundBudget::get();
+
+    while (!data->turns.empty() && ws->getBufferedAmount() < kHighWater) {
+      int64_t id = data->turns.front();
+      data->turns.pop_front();
+      auto& ch = *data->channels.at(id);
+
+      std::string frame = std::move(ch.ready.front());
+      ch.ready.pop_front();
+      if (!ch.ready.empty()) {
+        data->turns.push_back(id);
+      }
+
+      budget->sub_queued(ch.ws_common->outbound, frame.size());
+      auto send_status = ws->send(frame, uWS::TEXT, true);
+      ch.ws_common->pool.release(std::move(frame));
+
+      if (send_status == ws->SUCCESS) {
+        ch.ws_common->drained();
+      }
+    }
+
+    // The socket's buffer is shared by all channels, so it is accounted to the socket.
+    budget->set_buffered(data->ws_common->outbound, ws->getBufferedAmount());
+    budget->enforce();
+  }
+
+  template <typename WebSocket>
+  static void open_channel(WebSocket* ws, int64_t id, const std::string& cmd, const RequestMessage& req_msg) {
+    auto* data = ws->getUserData();
+    if (data->channels.count(id)) {
+      throw std::invalid_argument("Channel already open.");
+    }
+
+    auto ch = std::make_unique<Channel>();
+    auto ws_common = std::make_shared<WSCommon>();
+    ch->ws_common = ws_common;
+    ws_common->handle = data->ws_common->handle;
+    ws_common->envelope_fields = strutil::cat("\"channel\":", id, ",");
+    ws_common->LoadCommonOptions(req_msg);
+    ws_common->deliver_hook = [data, id, self = ws_common.get()](std::string frame) {
+      deliver<WebSocket>(data, id, self, std::move(frame));
+    };
+    ws_common->end_hook = [data, id, self = ws_common.get()](int, std::string reason) {
+      close_channel<WebSocket>(data, id, reason, self);
+    };
+
+    // The A0 threads started below can't send before this returns: sends are run on this thread.
+    if (cmd == "subscribe") {
+      req_msg.require("topic");
+      WSRead::AlephZeroCallback cb(ws, ws_common, req_msg);
+      cb.start_catchup(File(topic_path(env::topic_tmpl_pubsub(), req_msg.topic)));
+      ch->sub = std::make_unique<SubscriberZeroCopy>(
+          req_msg.topic, ws_common->reader_init, ws_common->reader_iter, std::move(cb));
+    } else if (cmd == "read") {
+      req_msg.require("path");
+      File file(req_msg.path);
+      WSRead::AlephZeroCallback cb(ws, ws_common, req_msg);
+      cb.start_catchup(file);
+      ch->reader = std::make_unique<ReaderZeroCopy>(
+          file, ws_common->reader_init, ws_common->reader_iter, std::move(cb));
+    } else if (cmd == "log") {
+      req_msg.require("topic");
+      LogLevel level = LogLevel::INFO;
+      req_msg.maybe_option_to("level", level_map(), level);
+      ch->listener = std::make_unique<LogListener>(
+          req_msg.topic, level, ws_common->reader_init, ws_common->reader_iter,
+          WSLog::AlephZeroCallback(ws, ws_common, req_msg));
+    } else if (cmd == "prpc") {
+      req_msg.require("topic");
+      ch->prpc_client = std::make_unique<PrpcClient>(req_msg.topic);
+      ch->prpc_connection_id = std::string(req_msg.pkt.id());
+      ch->prpc_callback = std::make_unique<WSPrpc::AlephZeroCallback>(ws, ws_common, req_msg);
+      WSPrpc::connect(*ch->prpc_client, req_msg.pkt, ch->prpc_callback.get());
+    } else {
+      throw std::invalid_argument(strutil::cat("Request has unknown value for field: cmd  value: ", cmd));
+    }
+
+    ws_common->start(ws);
+    // Shedding closes just this channel.
+    ws_common->outbound.shed = [data, id]() {
+      close_channel<WebSocket>(data, id, "Outbound budget exceeded.");
+    };
+    data->channels[id] = std::move(ch);
+  }
+
+  template <typename WebSocket>
+  static void onmessage(WebSocket* ws, std::string_view msg, uWS::OpCode code) {
+    if (code != uWS::OpCode::TEXT) {
+      return;
+    }
+
+    auto* data = ws->getUserData();
+    nlohmann::json channel_field;
+    try {
+      auto req_msg = ParseRequestMessage(msg);
+      req_msg.maybe_get_to("channel", channel_field);
+      auto id = req_msg.require_get<int64_t>("channel");
+      auto cmd = req_msg.require_get<std::string>("cmd");
+
+      if (cmd == "unsubscribe") {
+        close_channel<WebSocket>(data, id, "");
+      } else if (cmd == "ack") {
+        // If the channel's scheduler is ON_ACK, unblock its next message.
+        auto it = data->channels.find(id);
+        if (it != data->channels.end() && it->second->ws_common->sched == scheduler_t::ON_ACK) {
+          it->second->ws_common->wake();
+        }
+      } else if (cmd == "full") {
+        // If the channel sends deltas, send its next payload whole.
+        auto it = data->channels.find(id);
+        if (it != data->channels.end() && it->second->ws_common->delta) {
+          it->second->ws_common->delta->full_requested = true;
+        }
+      } else {
+        open_channel(ws, id, cmd, req_msg);
+      }
+    } catch (std::exception& e) {
+      send_error(ws, channel_field, e.what());
+    }
+  }
+
+  template <typename WebSocket>
+  static void ondrain(WebSocket* ws) {
+    auto* data = ws->getUserData();
+    OutboundBudget::get()->set_buffered(data->ws_common->outbound, ws->getBufferedAmount());
+    pump<WebSocket>(data);
+
+    // Sending may close channels, so work from a snapshot.
+    std::vector<std::shared_ptr<WSCommon>> ws_commons;
+    for (auto& [id, ch] : data->channels) {
+      ws_commons.push_back(ch->ws_common);
+    }
+    for (auto& ws_common : ws_commons) {
+      ws_common->maybe_send_pending<WebSocket>();
+    }
+
+    if (ws->getBufferedAmount() == 0) {
+      for (auto& [id, ch] : data->channels) {
+        if (ch->ready.empty()) {
+          ch->ws_common->drained();
+        }
+      }
+    }
+  }
+
+  static uWS::App::WebSocketBehavior<Data> behavior() {
+    return {
+        .compression = uWS::SHARED_COMPRESSOR,
+        .maxPayloadLength = 16 * 1024 * 1024,
+        .idleTimeout = 0,
+        .maxBackpressure = 16 * 1024 * 1024,
+        .closeOnBackpressureLimit = false,
+        .resetIdleTimeoutOnSend = true,
+        .upgrade = nullptr,
+        .open =
+            [](auto* ws) {
+              WSCommon::onopen(ws);
+              auto& ws_common = ws->getUserData()->ws_common;
+              ws_common->outbound.target = "mux";
+              ws_common->start(ws);
+            },
+        .message =
+            [](auto* ws, std::string_view msg, uWS::OpCode code) {
+              onmessage(ws, msg, code);
+            },
+        .drain =
+            [](auto* ws) {
+              ondrain(ws);
+            },
+        .ping = nullptr,
+        .pong = nullptr,
+        .close =
+            [](auto* ws, int code, std::string_view msg) {
+              auto* data = ws->getUserData();
+              for (auto& [id, ch] : data->channels) {
+                stop(*ch);
+              }
+              data->turns.clear();
+              data->ws_common->onclose(ws);
+            },
+    };
+  }
+};
+
+}  // namespace a0::api
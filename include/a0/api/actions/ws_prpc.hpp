@@ -4,6 +4,7 @@
 
 #include <memory>
 
+#include "a0/api/envelope.hpp"
 #include "a0/api/options.hpp"
 
 namespace a0::api {
@@ -14,8 +15,11 @@ namespace a0::api {
 //         topic: "...",                 // required
 //         iter: "NEXT",                 // optional, one of "NEXT", "NEWEST"
 //         request_encoding: "none",     // optional, one of "none", "base64"
-//         response_encoding: "none",    // optional, one of "none", "base64"
+//         response_encoding: "none",    // optional, one of "none", "base64", "json", "auto"
 //         scheduler: "ON_DRAIN",        // optional, one of "IMMEDIATE", "ON_ACK", "ON_DRAIN"
+//         backpressure: "THROTTLE",     // optional, one of "THROTTLE", "CONFLATE", "SHED"
+//         delta: false,                 // optional, send payloads as changes to the previous one
+//         delta_full_every: 100,        // optional, with delta. Send a whole payload this often. 0 for never
 //     }))
 // }
 // ws.onmessage = (evt) => {
@@ -25,7 +29,7 @@ struct WSPrpc {
   struct AlephZeroCallback {
     std::shared_ptr<WSCommon> ws_common;
     std::function<void(std::string)> send;
-    std::function<std::string(std::string_view)> response_encoder;
+    PayloadEncoder response_encoder;
 
     // If iter is ITER_NEWEST.
     struct NewestPkt {
@@ -39,17 +43,21 @@ struct WSPrpc {
     // Runs on uWS thread.
     template <typename WebSocket>
     AlephZeroCallback(WebSocket* ws, const RequestMessage& req_msg)
-        : ws_common{ws->getUserData()->ws_common},
+        : AlephZeroCallback(ws, ws->getUserData()->ws_common, req_msg) {}
+
+    // Runs on uWS thread. Sends as the given ws_common, ex: a channel of a multiplexed websocket.
+    template <typename WebSocket>
+    AlephZeroCallback(WebSocket* ws, std::shared_ptr<WSCommon> ws_common_, const RequestMessage& req_msg)
+        : ws_common{std::move(ws_common_)},
           send{ws_common->bind_send(ws)},
-          response_encoder{req_msg.response_encoder} {}
+          response_encoder{ws_common->payload_encoder(req_msg.response_encoder)} {}
 
     void do_send(Packet pkt, bool done) {
-      send(nlohmann::json({
-                              {"headers", strutil::flatten(pkt.headers())},
-                              {"payload", response_encoder(pkt.payload())},
-                              {"done", done},
-                          })
-               .dump());
+      std::string fields = ws_common->envelope_fields;
+      fields += done ? "\"done\":true," : "\"done\":false,";
+      std::string to_send = ws_common->pool.acquire(envelope_size_hint(pkt.payload().size()));
+      write_envelope(pkt, fields, response_encoder, to_send);
+      send(std::move(to_send));
     }
 
     void send_newest_locked() {
@@ -94,6 +102,28 @@ struct WSPrpc {
     }
   };
 
+  // Runs on uWS thread.
+  // The callback must outlive the client.
+  static void connect(PrpcClient& client, Packet pkt, AlephZeroCallback* callback) {
+    auto& ws_common = callback->ws_common;
+    if (ws_common->reader_iter == ITER_NEWEST) {
+      // Responses are sent under a lock the event loop also takes, so they must
+      // not block on the outbound budget. NEWEST only keeps the latest anyway.
+      // A delta stream can't drop frames, so it is shed instead.
+      if (ws_common->outbound.policy == backpressure_t::THROTTLE) {
+        ws_common->outbound.policy = ws_common->delta ? backpressure_t::SHED : backpressure_t::CONFLATE;
+      }
+      ws_common->wake_hook = [callback]() {
+        callback->send_newest();
+      };
+    }
+    client.connect(
+        std::move(pkt),
+        [callback](Packet pkt, bool done) {
+          (*callback)(std::move(pkt), done);
+        });
+  }
+
   struct Data {
     std::shared_ptr<WSCommon> ws_common;
     std::unique_ptr<PrpcClient> client;
@@ -110,13 +140,10 @@ struct WSPrpc {
         .closeOnBackpressureLimit = false,
         .resetIdleTimeoutOnSend = true,
         .upgrade = nullptr,
-        .open = [](auto* ws) { global()->active_ws.insert(ws); },
+        .open = [](auto* ws) { WSCommon::onopen(ws); },
         .message =
             [](auto* ws, std::string_view msg, uWS::OpCode code) {
               auto* data = ws->getUserData();
-              if (!data->ws_common) {
-                data->ws_common = std::make_shared<WSCommon>();
-              }
               data->ws_common->OnMessageWithHandshake(
                   ws, msg, code, [ws, data](const RequestMessage& req_msg) {
                     req_msg.require("topic");
@@ -124,16 +151,7 @@ struct WSPrpc {
                     data->client = std::make_unique<PrpcClient>(req_msg.topic);
                     data->connection_id = std::string(req_msg.pkt.id());
                     data->alephzero_callback = std::make_unique<AlephZeroCallback>(ws, req_msg);
-                    if (data->ws_common->reader_iter == ITER_NEWEST) {
-                      data->ws_common->wake_hook = [data]() {
-                        data->alephzero_callback->send_newest();
-                      };
-                    }
-                    data->client->connect(
-                        std::move(req_msg.pkt),
-                        [data](Packet pkt, bool done) {
-                          (*data->alephzero_callback)(std::move(pkt), done);
-                        });
+                    connect(*data->client, std::move(req_msg.pkt), data->alephzero_callback.get());
                   });
             },
         .drain =
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <App.h>
+#include <a0.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include "a0/api/actions/ws_read.hpp"
+#include "a0/api/aggregate.hpp"
+#include "a0/api/loop_watchdog.hpp"
+#include "a0/api/options.hpp"
+#include "a0/api/strutil.hpp"
+#include "a0/api/ws_common.hpp"
+
+namespace a0::api {
+
+// ws = new WebSocket(`ws://${api_addr}/wsapi/psub`)
+// ws.onopen = () => {
+//     ws.send(JSON.stringify({
+//         topic: "robot/arm/*",         // required, glob over pubsub topics
+//         max_topics: 64,               // optional, the socket closes if more topics match
+//         init: "AWAIT_NEW",            // optional, one of "OLDEST", "MOST_RECENT", "AWAIT_NEW"
+//         iter: "NEXT",                 // optional, one of "NEXT", "NEWEST"
+//         response_encoding: "none",    // optional, one of "none", "base64", "json", "auto"
+//         scheduler: "ON_DRAIN",        // optional, one of "IMMEDIATE", "ON_ACK", "ON_DRAIN"
+//         backpressure: "THROTTLE",     // optional, one of "THROTTLE", "SHED"
+//         filter: null,                 // optional, header predicate. ex: {key: "source", eq: "lidar_front"}
+//         aggregate: null,              // optional, per topic window summaries. ex: {fields: ["/x"], window_ms: 1000}
+//         chunk_size: 0,                // optional, send larger payloads as base64 fragments of this many bytes. 0 for never
+//         catchup: false,               // optional, with init "OLDEST". Send history in batches, then mark the live edge
+//     }))
+// }
+// ws.onmessage = (evt) => {
+//     ... JSON.parse(evt.data).topic ...
+// }
+//
+// All topics share the socket's WSCommon, so the scheduler paces the socket as
+// a whole: one ACK, or drain, releases the next message of every waiting topic.
+struct WSPsub {
+  static constexpr uint64_t kDefaultMaxTopics = 64;
+
+  // Access and edit only in uWS thread.
+  // Owns A0 threads.
+  struct Data {
+    std::shared_ptr<WSCommon> ws_common;
+    std::map<std::string, std::unique_ptr<SubscriberZeroCopy>> subs;
+    uint64_t max_topics{kDefaultMaxTopics};
+    // Topics that matched at the handshake. They are read with the requested init.
+    std::set<std::string> existing;
+    // Options shared by every subscriber.
+    std::unique_ptr<RequestMessage> req_msg;
+    // Declared last, so it stops before the subscribers.
+    std::unique_ptr<Discovery> discovery;
+  };
+
+  // The topic of a pubsub file, relative to the root.
+  static std::string topic_of(const std::string& relpath) {
+    static const std::string tmpl_key = "{topic}";
+    std::string tmpl = env::topic_tmpl_pubsub();
+    size_t prefix = tmpl.find(tmpl_key);
+    size_t suffix = tmpl.size() - prefix - tmpl_key.size();
+    return relpath.substr(prefix, relpath.size() - prefix - suffix);
+  }
+
+  // Topics whose files match the glob right now.
+  // Runs on the event loop, so only walks the directories the glob can match in:
+  // below its last wildcard-free directory, and no deeper than its components, unless it has "**".
+  static std::set<std::string> scan(const std::string& glob_path) {
+    std::set<std::string> out;
+    a0_pathglob_t glob;
+    if (a0_pathglob_init(&glob, glob_path.c_str()) != A0_OK) {
+      return out;
+    }
+
+    std::filesystem::path base;
+    std::vector<std::string> rest;
+    for (auto&& part : std::filesystem::path(glob_path)) {
+      if (rest.empty() && part.string().find_first_of("*?[") == std::string::npos) {
+        base /= part;
+      } else {
+        rest.push_back(part.string());
+      }
+    }
+    if (rest.empty()) {
+      // No wildcards. At most the one file.
+      rest.push_back(base.filename().string());
+      base = base.parent_path();
+    }
+    bool recursive = std::find(rest.begin(), rest.end(), "**") != rest.end();
+    int max_depth = int(rest.size()) - 1;
+
+    std::error_code ec;
+    std::filesystem::recursive_directory_iterator it(base, ec), end;
+    for (; !ec && it != end; it.increment(ec)) {
+      if (!recursive && it.depth() >= max_depth) {
+        it.disable_recursion_pending();
+      }
+      bool match = false;
+      if (it->is_regular_file(ec) &&
+          a0_pathglob_match(glob, it->path().c_str(), &match) == A0_OK && match) {
+        out.insert(topic_of(std::string(std::filesystem::relative(it->path(), env::root()))));
+      }
+    }
+    return out;
+  }
+
+  // Runs on uWS thread.
+  template <typename WebSocket>
+  static void attach(WebSocket* ws, const std::string& topic) {
+    auto* data = ws->getUserData();
+    if (data->subs.count(topic) || data->ws_common->done) {
+      return;
+    }
+    if (data->subs.size() >= data->max_topics) {
+      data->ws_common->end(ws, 4000, strutil::cat("Too many topics matched. max_topics: ", data->max_topics));
+      return;
+    }
+
+    auto init = data->ws_common->reader_init;
+    if (!data->existing.count(topic)) {
+      // A new topic. Read from its first packet, so nothing published before it was attached is missed.
+      init = data->ws_common->reader_iter == Reader::Iter::NEXT ? Reader::Init::OLDEST : Reader::Init::MOST_RECENT;
+    }
+
+    WSRead::AlephZeroCallback cb(ws, *data->req_msg);
+    cb.envelope_fields += strutil::cat("\"topic\":", nlohmann::json(topic).dump(), ",");
+    try {
+      cb.start_catchup(File(topic_path(env::topic_tmpl_pubsub(), topic)));
+    } catch (std::exception& e) {
+      data->ws_common->end(ws, 1011, e.what());
+      return;
+    }
+    data->subs[topic] = std::make_unique<SubscriberZeroCopy>(
+        topic, init, data->ws_common->reader_iter, std::move(cb));
+  }
+
+  static uWS::App::WebSocketBehavior<Data> behavior() {
+    return {
+        .compression = uWS::SHARED_COMPRESSOR,
+        .maxPayloadLength = 16 * 1024 * 1024,
+        .idleTimeout = 0,
+        .maxBackpressure = 16 * 1024 * 1024,
+        .closeOnBackpressureLimit = false,
+        .resetIdleTimeoutOnSend = true,
+        .upgrade = nullptr,
+        .open = [](auto* ws) { WSCommon::onopen(ws); },
+        .message =
+            [](auto* ws, std::string_view msg, uWS::OpCode code) {
+              auto* data = ws->getUserData();
+              data->ws_common->OnMessageWithHandshake(
+                  ws, msg, code, [ws, data](const RequestMessage& req_msg) {
+                    using WebSocket = std::remove_pointer_t<decltype(ws)>;
+                    req_msg.require("topic");
+                    // Topics share the socket, so one topic's frames can't replace another's.
+                    if (data->ws_common->outbound.policy == backpressure_t::CONFLATE) {
+                      throw std::invalid_argument("Option backpressure CONFLATE isn't supported for psub.");
+                    }
+                    if (data->ws_common->delta) {
+                      throw std::invalid_argument("Option delta isn't supported for psub.");
+                    }
+                    // Subscribers are created later, so check the aggregate now.
+                    auto aggregate_field = req_msg.raw_msg.find("aggregate");
+                    if (aggregate_field != req_msg.raw_msg.end() && !aggregate_field->is_null()) {
+                      Aggregator::Parse(*aggregate_field);
+                    }
+                    req_msg.maybe_get_to("max_topics", data->max_topics);
+                    data->req_msg = std::make_unique<RequestMessage>(req_msg);
+
+                    std::string glob_path =
+                        std::filesystem::path(env::root()) / topic_path(env::topic_tmpl_pubsub(), req_msg.topic);
+                    // Taken before discovery starts, so any topic missing from it was created since.
+                    data->existing = scan(glob_path);
+                    auto ws_common = data->ws_common;
+                    data->discovery = std::make_unique<Discovery>(
+                        glob_path, [ws_common](const std::string& path) {
+                          // Runs on A0 thread. Subscribers are created on the event loop.
+                          if (!global()->running) {
+                            return;
+                          }
+                          std::string topic = topic_of(std::string(std::filesystem::relative(path, env::root())));
+                          defer("ws_psub", [ws_common, topic]() {
+                            if (auto* ws = ws_common->socket<WebSocket>()) {
+                              attach(ws, topic);
+                            }
+                          });
+                        });
+                  });
+            },
+        .drain =
+            [](auto* ws) {
+              auto* data = ws->getUserData();
+              if (data->ws_common) {
+                data->ws_common->ondrain(ws);
+              }
+            },
+        .ping = nullptr,
+        .pong = nullptr,
+        .close =
+            [](auto* ws, int code, std::string_view msg) {
+              auto* data = ws->getUserData();
+              if (data->ws_common) {
+                data->ws_common->onclose(ws);
+              }
+            },
+    };
+  }
+};
+
+}  // namespace a0::api
@@ -2,10 +2,19 @@
 
 #include <App.h>
 
+#include <algorithm>
 #include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 
+#include "a0/api/aggregate.hpp"
+#include "a0/api/envelope.hpp"
 #include "a0/api/options.hpp"
 #include "a0/api/scope.hpp"
+#include "a0/api/strutil.hpp"
+#include "a0/api/timers.hpp"
 #include "a0/api/ws_common.hpp"
 
 namespace a0::api {
@@ -16,14 +25,26 @@ namespace a0::api {
 //         path: "...",                  // required
 //         init: "AWAIT_NEW",            // optional, one of "OLDEST", "MOST_RECENT", "AWAIT_NEW"
 //         iter: "NEXT",                 // optional, one of "NEXT", "NEWEST"
-//         response_encoding: "none",    // optional, one of "none", "base64"
+//         response_encoding: "none",    // optional, one of "none", "base64", "json", "auto"
 //         scheduler: "ON_DRAIN",        // optional, one of "IMMEDIATE", "ON_ACK", "ON_DRAIN"
+//         backpressure: "THROTTLE",     // optional, one of "THROTTLE", "CONFLATE", "SHED"
+//         filter: null,                 // optional, header predicate. ex: {key: "source", eq: "lidar_front"}
+//         delta: false,                 // optional, send payloads as changes to the previous one
+//         delta_full_every: 100,        // optional, with delta. Send a whole payload this often. 0 for never
+//         aggregate: null,              // optional, send window summaries in place of packets. ex: {fields: ["/x"], window_ms: 1000}
+//         chunk_size: 0,                // optional, send larger payloads as base64 fragments of this many bytes. 0 for never
+//         catchup: false,               // optional, with init "OLDEST". Send history in batches, then mark the live edge
 //     }))
 // }
 // ws.onmessage = (evt) => {
 //     ... evt.data ...
 // }
 struct WSRead {
+  // Smallest fragment of a chunked payload. Fragments are a multiple of 3 bytes, so their base64 concatenates.
+  static constexpr size_t kMinChunkSize = 3 * 1024;
+  // A catch-up batch is sent once it holds this much. About what a socket writes out per drain.
+  static constexpr size_t kCatchUpBatchBytes = 1024 * 1024;
+
   // Access and edit only in uWS thread.
   // Owns A0 thread.
   struct Data {
@@ -33,61 +54,308 @@ struct WSRead {
 
   struct AlephZeroCallback {
     std::shared_ptr<WSCommon> ws_common;
-    std::function<std::string(std::string_view)> response_encoder;
+    PayloadEncoder response_encoder;
+    // Starts as the ws_common's. Streams sharing a ws_common may add their own.
+    std::string envelope_fields;
     std::function<void(std::string)> send;
     std::function<void(int, std::string)> end;
+    // Optional. Packets are summarized, and only the summaries are sent.
+    std::shared_ptr<Aggregator> aggregate;
+    // Payloads larger than this are sent in fragments. 0 to never fragment.
+    size_t chunk_size{0};
+    // Set while catching up on history. Cleared at the newest packet.
+    bool catchup{false};
+    // Envelopes gathered while catching up, as an unterminated {"batch":[ frame.
+    std::string batch;
 
     // Runs on uWS thread.
     template <typename WebSocket>
     AlephZeroCallback(WebSocket* ws, const RequestMessage& req_msg)
-        : ws_common{ws->getUserData()->ws_common},
-          response_encoder{req_msg.response_encoder},
+        : AlephZeroCallback(ws, ws->getUserData()->ws_common, req_msg) {}
+
+    // Runs on uWS thread. Sends as the given ws_common, ex: a channel of a multiplexed websocket.
+    template <typename WebSocket>
+    AlephZeroCallback(WebSocket* ws, std::shared_ptr<WSCommon> ws_common_, const RequestMessage& req_msg)
+        : ws_common{std::move(ws_common_)},
+          response_encoder{ws_common->payload_encoder(req_msg.response_encoder)},
+          envelope_fields{ws_common->envelope_fields},
           send{ws_common->bind_send(ws)},
-          end{ws_common->bind_end(ws)} {}
+          end{ws_common->bind_end(ws)} {
+      auto aggregate_field = req_msg.raw_msg.find("aggregate");
+      if (aggregate_field != req_msg.raw_msg.end() && !aggregate_field->is_null()) {
+        if (ws_common->delta) {
+          throw std::invalid_argument("Option aggregate can't be combined with delta.");
+        }
+        aggregate = Aggregator::Parse(*aggregate_field);
+        schedule_flush(aggregate, send);
+      }
 
-    // Runs on A0 thread.
-    void operator()(TransportLocked tlk, FlatPacket fpkt_cpp) {
-      if (!global()->running) {
+      req_msg.maybe_get_to("chunk_size", chunk_size);
+      if (chunk_size) {
+        // Fragments are encoded on their own, and all of them are needed to rebuild the payload.
+        if (ws_common->delta) {
+          throw std::invalid_argument("Option chunk_size can't be combined with delta.");
+        }
+        if (ws_common->outbound.policy == backpressure_t::CONFLATE) {
+          throw std::invalid_argument("Option chunk_size can't be combined with CONFLATE backpressure.");
+        }
+        chunk_size = std::max(chunk_size, kMinChunkSize) / 3 * 3;
+      }
+
+      req_msg.maybe_get_to("catchup", catchup);
+      if (catchup) {
+        // A dropped batch would leave a gap in the history, or lose the live marker.
+        if (ws_common->outbound.policy == backpressure_t::CONFLATE) {
+          throw std::invalid_argument("Option catchup can't be combined with CONFLATE backpressure.");
+        }
+        // Only a reader starting from history has any to catch up on. Aggregates don't wait per packet anyway.
+        catchup = !aggregate && ws_common->reader_init == Reader::Init::OLDEST;
+      }
+    }
+
+    // Runs on uWS thread, before the reader starts.
+    // The reader doesn't call back on an empty file, so an empty history is marked live up front.
+    void start_catchup(const File& file) {
+      if (!catchup) {
         return;
       }
+      a0_transport_t transport;
+      a0_transport_locked_t tlk;
+      if (a0_transport_init(&transport, file.c->arena) != A0_OK || a0_transport_lock(&transport, &tlk) != A0_OK) {
+        throw std::runtime_error(strutil::cat("Failed to open file: ", file.path()));
+      }
+      bool empty = true;
+      a0_transport_empty(tlk, &empty);
+      a0_transport_unlock(tlk);
+      if (empty) {
+        catchup = false;
+        send(strutil::cat("{", envelope_fields, "\"batch\":[],\"live\":true}"));
+      }
+    }
 
+    // Runs on uWS thread.
+    // Sends windows left open by a quiet stream. Stops once the reader is gone.
+    static void schedule_flush(std::weak_ptr<Aggregator> weak_aggregate, std::function<void(std::string)> send) {
+      auto aggregate = weak_aggregate.lock();
+      if (!aggregate) {
+        return;
+      }
+      Timers::get()->after(aggregate->flush_period_ms(), [weak_aggregate, send]() {
+        auto aggregate = weak_aggregate.lock();
+        if (!global()->running || !aggregate) {
+          return;
+        }
+        std::vector<std::string> frames;
+        aggregate->flush_idle(frames);
+        for (auto& frame : frames) {
+          send(std::move(frame));
+        }
+        schedule_flush(weak_aggregate, send);
+      });
+    }
+
+    // Runs on A0 thread.
+    // Returns the summaries closed by the packet. Nothing is sent for most packets.
+    std::vector<std::string> summarize(a0_flat_packet_t fpkt) {
+      const char* wall = nullptr;
+      a0_flat_packet_header_iterator_t iter;
+      a0_packet_header_t hdr;
+      a0_flat_packet_header_iterator_init(&iter, &fpkt);
+      while (a0_flat_packet_header_iterator_next(&iter, &hdr) == A0_OK) {
+        if (std::string_view(hdr.key) == "a0_time_wall") {
+          wall = hdr.val;
+          break;
+        }
+      }
+
+      a0_buf_t payload;
+      a0_flat_packet_payload(fpkt, &payload);
+
+      std::vector<std::string> frames;
+      aggregate->add(wall, std::string_view((const char*)payload.data, payload.size), envelope_fields, frames);
+      return frames;
+    }
+
+    // Runs on A0 thread, with the transport locked.
+    // Each fragment is encoded out of the transport while locked, and sent while unlocked,
+    // once the socket has written out the one before. Only one fragment is held at a time.
+    void send_chunked(TransportLocked tlk, a0_flat_packet_t fpkt, a0_buf_t payload) {
+      uint64_t seq = tlk.frame().hdr.seq;
+      size_t total = payload.size;
+      for (size_t offset = 0; offset < total; offset += chunk_size) {
+        size_t len = std::min(chunk_size, total - offset);
+        bool last = offset + len == total;
+
+        std::string frame = ws_common->pool.acquire(envelope_size_hint(len));
+        frame.push_back('{');
+        frame += envelope_fields;
+        if (offset == 0) {
+          write_headers(fpkt, frame);
+          frame.push_back(',');
+        }
+        frame += strutil::cat("\"chunk\":{\"id\":", seq, ",\"offset\":", offset, ",\"total\":", total, "},");
+        base64::write_payload(std::string_view((const char*)payload.data + offset, len), frame);
+        frame += ",\"encoding\":\"base64\"}";
+
+        {
+          auto eos_relock_transport = scope_unlock_transport(*tlk.c);
+          int64_t pre_send_cnt = ws_common->wake_cnt;
+          int64_t pre_drain_cnt = ws_common->drain_cnt;
+          send(std::move(frame));
+          if (last) {
+            // The scheduler applies between packets.
+            ws_common->wait(pre_send_cnt);
+            return;
+          }
+          ws_common->wait_drain(pre_drain_cnt);
+        }
+
+        if (!global()->running || ws_common->done) {
+          return;
+        }
+        // The packet may have been evicted while the transport was unlocked.
+        uint64_t seq_low = 0;
+        a0_transport_seq_low(*tlk.c, &seq_low);
+        if (seq_low > seq) {
+          send(strutil::cat("{", envelope_fields,
+                            "\"chunk\":{\"id\":", seq, ",\"offset\":", offset + len, ",\"total\":", total,
+                            ",\"aborted\":true}}"));
+          return;
+        }
+      }
+    }
+
+    // Runs on A0 thread.
+    bool skip(TransportLocked tlk, FlatPacket fpkt_cpp) const {
       // Skip packets prior to seq_min.
       if (tlk.frame().hdr.seq <= ws_common->reader_seq_min) {
-        return;
+        return true;
       }
+      // Drop filtered packets before copying anything out of the transport.
+      return ws_common->filter && !ws_common->filter->match(*fpkt_cpp.c);
+    }
 
-      // Copy data out of the transport.
-      // We can't use the data in the transport once we unlock.
-      a0_flat_packet_t fpkt_c = *fpkt_cpp.c;
-      std::vector<uint8_t> fpkt_copy_data(fpkt_c.buf.size);
-      a0_flat_packet_t fpkt_copy{{fpkt_copy_data.data(), fpkt_c.buf.size}};
-      memcpy(fpkt_copy.buf.data, fpkt_c.buf.data, fpkt_c.buf.size);
+    // Runs on A0 thread, with the transport locked, while catching up on history.
+    // Envelopes are gathered into one frame without unlocking the transport, and sent once
+    // the frame is full, or at the newest packet. That last frame is marked "live":true,
+    // and later packets are sent one at a time, as the scheduler allows.
+    void catch_up(TransportLocked tlk, FlatPacket fpkt_cpp) {
+      uint64_t seq_high = 0;
+      a0_transport_seq_high(*tlk.c, &seq_high);
+      bool at_edge = tlk.frame().hdr.seq >= seq_high;
 
-      // Unlock the transport. It needs to be relocked before the function returns.
-      auto eos_relock_transport = scope_unlock_transport(*tlk.c);
+      if (!skip(tlk, fpkt_cpp)) {
+        a0_flat_packet_t fpkt = *fpkt_cpp.c;
+        a0_buf_t payload;
+        a0_flat_packet_payload(fpkt, &payload);
+        if (chunk_size && payload.size > chunk_size) {
+          // Keep the order: what was gathered goes first.
+          flush_batch(tlk, false);
+          send_chunked(tlk, fpkt, payload);
+        } else {
+          size_t mark = batch.size();
+          if (batch.empty()) {
+            batch = ws_common->pool.acquire(kCatchUpBatchBytes + envelope_size_hint(fpkt.buf.size));
+            batch.push_back('{');
+            batch += envelope_fields;
+            batch += "\"batch\":[";
+          } else {
+            batch.push_back(',');
+          }
+          try {
+            // The batch carries the envelope fields once, at the top.
+            write_envelope(fpkt, "", response_encoder, batch);
+          } catch (std::exception& ex) {
+            batch.resize(mark);
+            end(1011, ex.what());
+            return;
+          }
+        }
+      }
 
-      auto headers = strutil::flatten_headers(fpkt_copy);
+      if (at_edge) {
+        catchup = false;
+        flush_batch(tlk, true);
+      } else if (batch.size() >= kCatchUpBatchBytes) {
+        flush_batch(tlk, false);
+      }
+    }
 
-      a0_buf_t payload_buf;
-      a0_flat_packet_payload(fpkt_copy, &payload_buf);
-      auto payload = response_encoder(string_view((const char*)payload_buf.data, payload_buf.size));
+    // Runs on A0 thread, with the transport locked.
+    // Sends the gathered batch, if any. With live, sends it even if empty, marked as the last.
+    void flush_batch(TransportLocked tlk, bool live) {
+      if (batch.empty() && !live) {
+        return;
+      }
+      if (batch.empty()) {
+        batch = strutil::cat("{", envelope_fields, "\"batch\":[");
+      }
+      batch += live ? "],\"live\":true}" : "]}";
 
-      // Save the event count before sending the message.
-      // Depending on the scheduler, the reader might block until the event counter increments.
+      auto eos_relock_transport = scope_unlock_transport(*tlk.c);
       int64_t pre_send_cnt = ws_common->wake_cnt;
+      send(std::exchange(batch, std::string()));
+      ws_common->wait(pre_send_cnt);
+    }
 
-      std::string to_send;
+    // Runs on A0 thread.
+    void operator()(TransportLocked tlk, FlatPacket fpkt_cpp) {
+      if (!global()->running) {
+        return;
+      }
+
+      if (catchup) {
+        catch_up(tlk, fpkt_cpp);
+        return;
+      }
+
+      if (skip(tlk, fpkt_cpp)) {
+        return;
+      }
+
+      a0_flat_packet_t fpkt = *fpkt_cpp.c;
+
+      // Summaries are computed straight out of the locked transport. The packet isn't copied.
+      if (aggregate) {
+        auto frames = summarize(fpkt);
+        if (frames.empty()) {
+          return;
+        }
+        auto eos_relock_transport = scope_unlock_transport(*tlk.c);
+        int64_t pre_send_cnt = ws_common->wake_cnt;
+        for (auto& frame : frames) {
+          send(std::move(frame));
+        }
+        ws_common->wait(pre_send_cnt);
+        return;
+      }
+
+      if (chunk_size) {
+        a0_buf_t payload;
+        a0_flat_packet_payload(fpkt, &payload);
+        if (payload.size > chunk_size) {
+          send_chunked(tlk, fpkt, payload);
+          return;
+        }
+      }
+
+      // Serialize the envelope straight out of the locked transport, into a pooled buffer sized for it.
+      // This is the only copy of the packet made before it is handed to the event loop.
+      std::string to_send = ws_common->pool.acquire(envelope_size_hint(fpkt.buf.size));
       try {
-        to_send = nlohmann::json({
-                                     {"headers", headers},
-                                     {"payload", payload},
-                                 })
-                      .dump();
+        write_envelope(fpkt, envelope_fields, response_encoder, to_send);
       } catch (std::exception& ex) {
         end(1011, ex.what());
         return;
       }
 
+      // Unlock the transport. It needs to be relocked before the function returns.
+      auto eos_relock_transport = scope_unlock_transport(*tlk.c);
+
+      // Save the event count before sending the message.
+      // Depending on the scheduler, the reader might block until the event counter increments.
+      int64_t pre_send_cnt = ws_common->wake_cnt;
+
       send(std::move(to_send));
 
       ws_common->wait(pre_send_cnt);
@@ -103,19 +371,18 @@ struct WSRead {
         .closeOnBackpressureLimit = false,
         .resetIdleTimeoutOnSend = true,
         .upgrade = nullptr,
-        .open = [](auto* ws) { global()->active_ws.insert(ws); },
+        .open = [](auto* ws) { WSCommon::onopen(ws); },
         .message =
             [](auto* ws, std::string_view msg, uWS::OpCode code) {
               auto* data = ws->getUserData();
-              if (!data->ws_common) {
-                data->ws_common = std::make_shared<WSCommon>();
-              }
               data->ws_common->OnMessageWithHandshake(
                   ws, msg, code, [ws, data](const RequestMessage& req_msg) {
                     req_msg.require("path");
+                    File file(req_msg.path);
+                    AlephZeroCallback cb(ws, req_msg);
+                    cb.start_catchup(file);
                     data->reader = std::make_unique<ReaderZeroCopy>(
-                        File(req_msg.path), data->ws_common->reader_init, data->ws_common->reader_iter,
-                        AlephZeroCallback(ws, req_msg));
+                        file, data->ws_common->reader_init, data->ws_common->reader_iter, std::move(cb));
                   });
             },
         .drain =
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <App.h>
+#include <a0.h>
+#include <nlohmann/json.hpp>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "a0/api/envelope.hpp"
+#include "a0/api/loop_watchdog.hpp"
+#include "a0/api/request_message.hpp"
+#include "a0/api/rpc_calls.hpp"
+#include "a0/api/strutil.hpp"
+#include "a0/api/timers.hpp"
+#include "a0/api/ws_common.hpp"
+
+namespace a0::api {
+
+// ws = new WebSocket(`ws://${api_addr}/wsapi/rpc`)
+// ws.onopen = () => {
+//     ws.send(JSON.stringify({
+//         id: ...,                      // required, any json value. Echoed back with the response
+//         topic: "...",                 // required
+//         packet: {
+//             headers: [                // optional
+//                 ["key", "val"],
+//                 ...
+//             ],
+//             payload: "...",           // required
+//         },
+//         request_encoding: "none",     // optional, one of "none", "base64"
+//         response_encoding: "none",    // optional, one of "none", "base64", "json", "auto"
+//         timeout_ms: 30000,            // optional, default set by RPC_TIMEOUT_MS. 0 for no deadline
+//     }))
+//     ws.send(JSON.stringify({
+//         id: ...,                      // cancels the pending request with this id
+//         cancel: true,
+//     }))
+// }
+// ws.onmessage = (evt) => {
+//     ... JSON.parse(evt.data).id ...
+// }
+struct WSRpc {
+  // Requests awaiting a response, keyed by a token the server assigns, so a
+  // reply or deadline meant for one request can't land on a later request
+  // that reuses its id.
+  // Accessed from all threads. Each request is answered exactly once: by
+  // whoever takes it out of the map first.
+  struct Calls {
+    using Token = uint64_t;
+
+    struct Call {
+      // The serialized client id.
+      std::string key;
+      RpcClient* client;
+      std::string pkt_id;
+      std::optional<Timers::Id> timer;
+    };
+
+    std::mutex mu;
+    Token next_token{0};
+    std::unordered_map<Token, Call> pending;
+    // Serialized client id -> token of the pending request.
+    std::unordered_map<std::string, Token> tokens;
+
+    // Throws if a request with the same id is still pending.
+    Token add(std::string key, RpcClient* client, std::string pkt_id) {
+      std::unique_lock<std::mutex> lk{mu};
+      if (tokens.count(key)) {
+        throw std::invalid_argument("Request id already pending.");
+      }
+      Token token = ++next_token;
+      tokens[key] = token;
+      pending[token] = {std::move(key), client, std::move(pkt_id), std::nullopt};
+      RpcCalls::get()->pending++;
+      return token;
+    }
+
+    void set_timer(Token token, Timers::Id timer) {
+      std::unique_lock<std::mutex> lk{mu};
+      auto it = pending.find(token);
+      if (it != pending.end()) {
+        it->second.timer = timer;
+      }
+    }
+
+    std::optional<Call> take(Token token) {
+      std::unique_lock<std::mutex> lk{mu};
+      auto it = pending.find(token);
+      if (it == pending.end()) {
+        return std::nullopt;
+      }
+      auto call = std::move(it->second);
+      pending.erase(it);
+      tokens.erase(call.key);
+      RpcCalls::get()->pending--;
+      return call;
+    }
+
+    // Takes the pending request with the given client id.
+    std::optional<Call> take(const std::string& key) {
+      Token token;
+      {
+        std::unique_lock<std::mutex> lk{mu};
+        auto it = tokens.find(key);
+        if (it == tokens.end()) {
+          return std::nullopt;
+        }
+        token = it->second;
+      }
+      return take(token);
+    }
+  };
+
+  // Access and edit only in uWS thread.
+  // Owns A0 threads.
+  struct Data {
+    std::shared_ptr<WSCommon> ws_common;
+    std::shared_ptr<Calls> calls{std::make_shared<Calls>()};
+    // One client per topic, for the life of the socket.
+    std::map<std::string, std::unique_ptr<RpcClient>> clients;
+  };
+
+  template <typename WebSocket>
+  static void send_error(WebSocket* ws, const nlohmann::json& id, std::string_view err) {
+    auto* data = ws->getUserData();
+    data->ws_common->send(ws, nlohmann::json({{"id", id}, {"error", std::string(err)}}).dump());
+  }
+
+  template <typename WebSocket>
+  static void request(WebSocket* ws, const nlohmann::json& id, const RequestMessage& req_msg) {
+    auto* data = ws->getUserData();
+    req_msg.require("topic");
+    req_msg.require(nlohmann::json::json_pointer("/packet/payload"));
+    uint64_t timeout_ms = RpcCalls::get()->default_timeout_ms;
+    req_msg.maybe_get_to("timeout_ms", timeout_ms);
+
+    auto& client = data->clients[req_msg.topic];
+    if (!client) {
+      try {
+        client = std::make_unique<RpcClient>(req_msg.topic);
+      } catch (...) {
+        data->clients.erase(req_msg.topic);
+        throw;
+      }
+    }
+
+    std::string key = id.dump();
+    auto token = data->calls->add(key, client.get(), std::string(req_msg.pkt.id()));
+
+    if (timeout_ms) {
+      auto timer = Timers::get()->after(timeout_ms, [calls = data->calls, ws_common = data->ws_common, token, id]() {
+        auto* ws = ws_common->socket<WebSocket>();
+        if (!ws) {
+          return;
+        }
+        if (auto call = calls->take(token)) {
+          RpcCalls::get()->timed_out++;
+          call->client->cancel(call->pkt_id);
+          send_error(ws, id, "Deadline exceeded.");
+        }
+      });
+      data->calls->set_timer(token, timer);
+    }
+
+    // Runs on A0 thread.
+    auto callback = [calls = data->calls, ws_common = data->ws_common, ws, token,
+                     fields = strutil::cat("\"id\":", key, ","),
+                     response_encoder = req_msg.response_encoder](Packet pkt) {
+      if (!global()->running) {
+        return;
+      }
+      auto call = calls->take(token);
+      if (!call) {
+        // Cancelled, or past its deadline.
+        return;
+      }
+      if (call->timer) {
+        // Timers are only touched on the event loop.
+        defer("ws_rpc", [timer = *call->timer]() { Timers::get()->cancel(timer); });
+      }
+      RpcCalls::get()->completed++;
+
+      std::string to_send = ws_common->pool.acquire(envelope_size_hint(pkt.payload().size()));
+      try {
+        write_envelope(pkt, fields, response_encoder, to_send);
+      } catch (std::exception& e) {
+        to_send = nlohmann::json({{"id", nlohmann::json::parse(call->key)}, {"error", e.what()}}).dump();
+      }
+      ws_common->send(ws, std::move(to_send));
+    };
+
+    client->send(req_msg.pkt, std::move(callback));
+  }
+
+  template <typename WebSocket>
+  static void cancel(WebSocket* ws, const nlohmann::json& id) {
+    auto* data = ws->getUserData();
+    auto call = data->calls->take(id.dump());
+    if (!call) {
+      // Already answered.
+      return;
+    }
+    if (call->timer) {
+      Timers::get()->cancel(*call->timer);
+    }
+    RpcCalls::get()->cancelled++;
+    call->client->cancel(call->pkt_id);
+    send_error(ws, id, "Cancelled.");
+  }
+
+  template <typename WebSocket>
+  static void onmessage(WebSocket* ws, std::string_view msg, uWS::OpCode code) {
+    if (code != uWS::OpCode::TEXT) {
+      return;
+    }
+
+    nlohmann::json id;
+    try {
+      auto req_msg = ParseRequestMessage(msg);
+      req_msg.require("id");
+      id = req_msg.raw_msg.at("id");
+
+      bool cancel_requested = false;
+      req_msg.maybe_get_to("cancel", cancel_requested);
+      if (cancel_requested) {
+        cancel(ws, id);
+      } else {
+        request(ws, id, req_msg);
+      }
+    } catch (std::exception& e) {
+      send_error(ws, id, e.what());
+    }
+  }
+
+  static uWS::App::WebSocketBehavior<Data> behavior() {
+    return {
+        .compression = uWS::SHARED_COMPRESSOR,
+        .maxPayloadLength = 16 * 1024 * 1024,
+        .idleTimeout = 0,
+        .maxBackpressure = 16 * 1024 * 1024,
+        .closeOnBackpressureLimit = false,
+        .resetIdleTimeoutOnSend = true,
+        .upgrade = nullptr,
+        .open =
+            [](auto* ws) {
+              WSCommon::onopen(ws);
+              auto& ws_common = ws->getUserData()->ws_common;
+              // Responses are never held back waiting for the client.
+              ws_common->sched = scheduler_t::IMMEDIATE;
+              ws_common->outbound.target = "rpc";
+              ws_common->start(ws);
+            },
+        .message =
+            [](auto* ws, std::string_view msg, uWS::OpCode code) {
+              onmessage(ws, msg, code);
+            },
+        .drain =
+            [](auto* ws) {
+              auto* data = ws->getUserData();
+              data->ws_common->ondrain(ws);
+            },
+        .ping = nullptr,
+        .pong = nullptr,
+        .close =
+            [](auto* ws, int code, std::string_view msg) {
+              auto* data = ws->getUserData();
+              std::unordered_map<Calls::Token, Calls::Call> pending;
+              {
+                std::unique_lock<std::mutex> lk{data->calls->mu};
+                pending.swap(data->calls->pending);
+                data->calls->tokens.clear();
+              }
+              RpcCalls::get()->pending -= pending.size();
+              RpcCalls::get()->cancelled += pending.size();
+              for (auto& [token, call] : pending) {
+                if (call.timer) {
+                  Timers::get()->cancel(*call.timer);
+                }
+                call.client->cancel(call.pkt_id);
+              }
+              data->ws_common->onclose(ws);
+            },
+    };
+  }
+};
+
+}  // namespace a0::api
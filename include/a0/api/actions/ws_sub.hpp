@@ -16,8 +16,15 @@ namespace a0::api {
 //         topic: "...",                 // required
 //         init: "AWAIT_NEW",            // optional, one of "OLDEST", "MOST_RECENT", "AWAIT_NEW"
 //         iter: "NEXT",                 // optional, one of "NEXT", "NEWEST"
-//         response_encoding: "none",    // optional, one of "none", "base64"
+//         response_encoding: "none",    // optional, one of "none", "base64", "json", "auto"
 //         scheduler: "ON_DRAIN",        // optional, one of "IMMEDIATE", "ON_ACK", "ON_DRAIN"
+//         backpressure: "THROTTLE",     // optional, one of "THROTTLE", "CONFLATE", "SHED"
+//         filter: null,                 // optional, header predicate. ex: {key: "source", eq: "lidar_front"}
+//         delta: false,                 // optional, send payloads as changes to the previous one
+//         delta_full_every: 100,        // optional, with delta. Send a whole payload this often. 0 for never
+//         aggregate: null,              // optional, send window summaries in place of packets. ex: {fields: ["/x"], window_ms: 1000}
+//         chunk_size: 0,                // optional, send larger payloads as base64 fragments of this many bytes. 0 for never
+//         catchup: false,               // optional, with init "OLDEST". Send history in batches, then mark the live edge
 //     }))
 // }
 // ws.onmessage = (evt) => {
@@ -38,19 +45,17 @@ struct WSSub {
         .closeOnBackpressureLimit = false,
         .resetIdleTimeoutOnSend = true,
         .upgrade = nullptr,
-        .open = [](auto* ws) { global()->active_ws.insert(ws); },
+        .open = [](auto* ws) { WSCommon::onopen(ws); },
         .message =
             [](auto* ws, std::string_view msg, uWS::OpCode code) {
               auto* data = ws->getUserData();
-              if (!data->ws_common) {
-                data->ws_common = std::make_shared<WSCommon>();
-              }
               data->ws_common->OnMessageWithHandshake(
                   ws, msg, code, [ws, data](const RequestMessage& req_msg) {
                     req_msg.require("topic");
+                    WSRead::AlephZeroCallback cb(ws, req_msg);
+                    cb.start_catchup(File(topic_path(env::topic_tmpl_pubsub(), req_msg.topic)));
                     data->sub = std::make_unique<SubscriberZeroCopy>(
-                        req_msg.topic, data->ws_common->reader_init, data->ws_common->reader_iter,
-                        WSRead::AlephZeroCallback(ws, req_msg));
+                        req_msg.topic, data->ws_common->reader_init, data->ws_common->reader_iter, std::move(cb));
                   });
             },
         .drain =
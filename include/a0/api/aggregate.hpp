@@ -0,0 +1,381 @@
+#pragma once
+
+#include <a0.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "a0/api/strutil.hpp"
+
+namespace a0::api {
+
+// Summaries of numeric payload fields over fixed windows, compiled from the
+// "aggregate" request field:
+//   {"fields": ["/pose/x", "/battery"], "window_ms": 1000}
+// window_ms may be a list, to summarize at several resolutions in one pass.
+//
+// Windows are aligned to multiples of their length since the epoch, and keyed
+// by the a0_time_wall header, so a replay from OLDEST downsamples history the
+// same way it was summarized live. Packets without the header use their
+// arrival time.
+//
+// Payloads are scanned with a SAX parser that stops once every field is found.
+// No json value is built.
+//
+// A window is written out once a packet arrives past its end, or once the
+// stream has been quiet for a window length after it:
+//   {"window_ms":1000,"start":"...","count":N,"fields":{"/pose/x":{"count":n,"min":..,"max":..,"mean":..,"last":..},...}}
+// "count" is the number of json payloads in the window. A field with no
+// numeric samples is null. Windows without payloads are skipped.
+//
+// add runs on the A0 thread and flush_idle on the event loop.
+struct Aggregator {
+  static constexpr size_t kMaxFields = 64;
+  static constexpr size_t kMaxWindows = 8;
+
+  struct Token {
+    std::string key;
+    // Set if the token can index an array.
+    std::optional<size_t> index;
+  };
+
+  struct Field {
+    std::string pointer;
+    std::vector<Token> tokens;
+  };
+
+  struct Stats {
+    uint64_t count{0};
+    double min{0};
+    double max{0};
+    double sum{0};
+    double last{0};
+
+    void add(double val) {
+      if (!count) {
+        min = max = val;
+      }
+      count++;
+      min = std::min(min, val);
+      max = std::max(max, val);
+      sum += val;
+      last = val;
+    }
+  };
+
+  struct Window {
+    int64_t length_ns;
+    int64_t start_ns{0};
+    uint64_t count{0};
+    std::vector<Stats> stats;
+  };
+
+  std::vector<Field> fields;
+  std::vector<Window> windows;
+
+  static std::shared_ptr<Aggregator> Parse(const nlohmann::json& spec) {
+    if (!spec.is_object()) {
+      throw std::invalid_argument("Invalid aggregate: must be a json object.");
+    }
+
+    auto agg = std::make_shared<Aggregator>();
+    if (!spec.contains("fields") || !spec.at("fields").is_array() || spec.at("fields").empty()) {
+      throw std::invalid_argument("Invalid aggregate: requires a non-empty list of 'fields'.");
+    }
+    if (spec.at("fields").size() > kMaxFields) {
+      throw std::invalid_argument(strutil::cat("Invalid aggregate: at most ", kMaxFields, " fields allowed."));
+    }
+    for (const auto& pointer : spec.at("fields")) {
+      if (!pointer.is_string()) {
+        throw std::invalid_argument("Invalid aggregate: each field must be a json pointer string.");
+      }
+      agg->fields.push_back(parse_pointer(pointer.get<std::string>()));
+    }
+
+    if (!spec.contains("window_ms")) {
+      throw std::invalid_argument("Invalid aggregate: requires 'window_ms'.");
+    }
+    auto lengths = spec.at("window_ms");
+    if (!lengths.is_array()) {
+      lengths = nlohmann::json::array({lengths});
+    }
+    if (lengths.empty() || lengths.size() > kMaxWindows) {
+      throw std::invalid_argument(strutil::cat("Invalid aggregate: 'window_ms' takes 1 to ", kMaxWindows, " lengths."));
+    }
+    for (const auto& length : lengths) {
+      if (!length.is_number_unsigned() || length.get<uint64_t>() == 0) {
+        throw std::invalid_argument("Invalid aggregate: each 'window_ms' must be a positive integer.");
+      }
+      Window window;
+      window.length_ns = int64_t(length.get<uint64_t>()) * 1000000;
+      window.stats.resize(agg->fields.size());
+      agg->windows.push_back(std::move(window));
+    }
+    return agg;
+  }
+
+  // How often the event loop should check for quiet windows.
+  uint64_t flush_period_ms() const {
+    int64_t shortest = windows[0].length_ns;
+    for (const auto& window : windows) {
+      shortest = std::min(shortest, window.length_ns);
+    }
+    return std::clamp<int64_t>(shortest / 2000000, 1, 1000);
+  }
+
+  // wall is the a0_time_wall header value, or nullptr if missing.
+  // envelope_fields are added to the frames, as to a packet's envelope.
+  // Appends the frames of any windows the packet closed.
+  void add(const char* wall, std::string_view payload, const std::string& envelope_fields, std::vector<std::string>& out) {
+    std::vector<std::optional<double>> vals(fields.size());
+    Scanner scanner{fields, vals};
+    bool parsed = nlohmann::json::sax_parse(payload.begin(), payload.end(), &scanner);
+    // The scan stops early once every field is found.
+    if (!parsed && scanner.found < fields.size()) {
+      return;
+    }
+
+    int64_t now_ns = wall_now_ns();
+    int64_t time_ns = now_ns;
+    a0_time_wall_t header_time;
+    if (wall && a0_time_wall_parse(wall, &header_time) == A0_OK) {
+      time_ns = int64_t(header_time.ts.tv_sec) * 1000000000 + header_time.ts.tv_nsec;
+    }
+
+    std::unique_lock<std::mutex> lk{mu};
+    last_arrival_ns = now_ns;
+    if (envelope != envelope_fields) {
+      envelope = envelope_fields;
+    }
+    for (auto& window : windows) {
+      // Also restarts when time goes backwards.
+      if (window.count && (time_ns < window.start_ns || time_ns >= window.start_ns + window.length_ns)) {
+        out.push_back(take(window));
+      }
+      if (!window.count) {
+        window.start_ns = time_ns - floor_mod(time_ns, window.length_ns);
+      }
+      window.count++;
+      for (size_t i = 0; i < fields.size(); i++) {
+        if (vals[i]) {
+          window.stats[i].add(*vals[i]);
+        }
+      }
+    }
+  }
+
+  // Appends the frames of windows that ended, followed by a window length without packets.
+  void flush_idle(std::vector<std::string>& out) {
+    int64_t now_ns = wall_now_ns();
+    std::unique_lock<std::mutex> lk{mu};
+    for (auto& window : windows) {
+      if (window.count &&
+          now_ns >= window.start_ns + window.length_ns &&
+          now_ns - last_arrival_ns >= window.length_ns) {
+        out.push_back(take(window));
+      }
+    }
+  }
+
+ private:
+  // Tracks the json pointer of the current value, and records numbers at the requested ones.
+  struct Scanner : nlohmann::json_sax<nlohmann::json> {
+    struct Level {
+      bool array;
+      size_t index;
+      std::string key;
+    };
+
+    const std::vector<Field>& fields;
+    std::vector<std::optional<double>>& vals;
+    std::vector<Level> path;
+    size_t found{0};
+
+    Scanner(const std::vector<Field>& fields_, std::vector<std::optional<double>>& vals_)
+        : fields{fields_}, vals{vals_} {}
+
+    bool null() override {
+      value();
+      return true;
+    }
+    bool boolean(bool) override {
+      value();
+      return true;
+    }
+    bool number_integer(number_integer_t val) override {
+      return number(double(val));
+    }
+    bool number_unsigned(number_unsigned_t val) override {
+      return number(double(val));
+    }
+    bool number_float(number_float_t val, const string_t&) override {
+      return number(double(val));
+    }
+    bool string(string_t&) override {
+      value();
+      return true;
+    }
+    bool binary(binary_t&) override {
+      value();
+      return true;
+    }
+    bool start_object(std::size_t) override {
+      value();
+      path.push_back({false, 0, {}});
+      return true;
+    }
+    bool key(string_t& key) override {
+      path.back().key = key;
+      return true;
+    }
+    bool end_object() override {
+      path.pop_back();
+      return true;
+    }
+    bool start_array(std::size_t) override {
+      value();
+      path.push_back({true, 0, {}});
+      return true;
+    }
+    bool end_array() override {
+      path.pop_back();
+      return true;
+    }
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override {
+      return false;
+    }
+
+    // Called before each value, to advance the index of an enclosing array.
+    void value() {
+      if (!path.empty() && path.back().array) {
+        path.back().index++;
+      }
+    }
+
+    bool number(double val) {
+      value();
+      for (size_t i = 0; i < fields.size(); i++) {
+        if (!vals[i] && at(fields[i])) {
+          vals[i] = val;
+          found++;
+        }
+      }
+      // Stop parsing once nothing after this point is needed.
+      return found < fields.size();
+    }
+
+    bool at(const Field& field) const {
+      if (field.tokens.size() != path.size()) {
+        return false;
+      }
+      for (size_t i = 0; i < path.size(); i++) {
+        const auto& level = path[i];
+        const auto& token = field.tokens[i];
+        // An array's index was advanced past the current value.
+        if (level.array ? token.index != level.index - 1 : token.key != level.key) {
+          return false;
+        }
+      }
+      return true;
+    }
+  };
+
+  static Field parse_pointer(const std::string& pointer) {
+    if (!pointer.empty() && pointer[0] != '/') {
+      throw std::invalid_argument(strutil::cat("Invalid aggregate: field isn't a json pointer: ", pointer));
+    }
+    Field field;
+    field.pointer = pointer;
+    size_t pos = 0;
+    while (pos < pointer.size()) {
+      size_t next = pointer.find('/', pos + 1);
+      if (next == std::string::npos) {
+        next = pointer.size();
+      }
+      Token token;
+      for (size_t i = pos + 1; i < next; i++) {
+        if (pointer[i] != '~') {
+          token.key.push_back(pointer[i]);
+        } else if (i + 1 < next && (pointer[i + 1] == '0' || pointer[i + 1] == '1')) {
+          token.key.push_back(pointer[++i] == '0' ? '~' : '/');
+        } else {
+          throw std::invalid_argument(strutil::cat("Invalid aggregate: bad escape in json pointer: ", pointer));
+        }
+      }
+      if (!token.key.empty() && token.key.size() < 20 &&
+          std::all_of(token.key.begin(), token.key.end(), [](char c) { return c >= '0' && c <= '9'; }) &&
+          (token.key == "0" || token.key[0] != '0')) {
+        token.index = std::stoull(token.key);
+      }
+      field.tokens.push_back(std::move(token));
+      pos = next;
+    }
+    return field;
+  }
+
+  static int64_t floor_mod(int64_t a, int64_t b) {
+    int64_t m = a % b;
+    return m < 0 ? m + b : m;
+  }
+
+  static int64_t wall_now_ns() {
+    a0_time_wall_t now;
+    a0_time_wall_now(&now);
+    return int64_t(now.ts.tv_sec) * 1000000000 + now.ts.tv_nsec;
+  }
+
+  // Serializes the window, and resets it.
+  std::string take(Window& window) {
+    a0_time_wall_t start;
+    start.ts.tv_sec = window.start_ns / 1000000000;
+    start.ts.tv_nsec = window.start_ns % 1000000000;
+    char start_str[36];
+    a0_time_wall_str(start, start_str);
+
+    std::string out = strutil::cat(
+        "{", envelope,
+        "\"window_ms\":", window.length_ns / 1000000,
+        ",\"start\":\"", start_str, "\"",
+        ",\"count\":", window.count,
+        ",\"fields\":{");
+    for (size_t i = 0; i < fields.size(); i++) {
+      if (i) {
+        out.push_back(',');
+      }
+      out += nlohmann::json(fields[i].pointer).dump();
+      out.push_back(':');
+      auto& stats = window.stats[i];
+      if (!stats.count) {
+        out += "null";
+      } else {
+        out += nlohmann::json({
+                                  {"count", stats.count},
+                                  {"min", stats.min},
+                                  {"max", stats.max},
+                                  {"mean", stats.sum / stats.count},
+                                  {"last", stats.last},
+                              })
+                   .dump();
+      }
+      stats = Stats{};
+    }
+    out += "}}";
+    window.count = 0;
+    return out;
+  }
+
+  std::mutex mu;
+  int64_t last_arrival_ns{0};
+  // The envelope_fields of the last packet. Used for frames sent by flush_idle.
+  std::string envelope;
+};
+
+}  // namespace a0::api
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace a0::api {
+
+// Size-classed pool of recycled frame buffers.
+//
+// Each websocket owns a pool: its A0 thread acquires a buffer to serialize
+// a frame into, and the event loop releases it back once the frame has been
+// handed to the socket. Buffers are bucketed by power-of-two capacity, from
+// 1KB up to the 16MB frame limit. Each bucket keeps only a few, and buckets
+// of 1MB and up keep one, so steady traffic stops hitting malloc.
+//
+// All pools together hold at most max_bytes_held. Past it, released buffers
+// are freed, however many sockets are open.
+struct BufferPool {
+  static constexpr size_t kMinClass = 10;
+  static constexpr size_t kMaxClass = 24;
+  static constexpr size_t kPerClass = 4;
+  static constexpr size_t kLargeClass = 20;
+  static constexpr size_t kPerLargeClass = 1;
+
+  // Process-wide, across all pools.
+  struct Counters {
+    std::atomic<int64_t> max_bytes_held{64 << 20};
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    // Buffers freed on release, because the pools were at max_bytes_held.
+    std::atomic<uint64_t> over_cap{0};
+    std::atomic<int64_t> bytes_held{0};
+    std::atomic<int64_t> buffers_held{0};
+  };
+
+  static Counters& counters() {
+    static Counters c;
+    return c;
+  }
+
+  static nlohmann::json stats() {
+    auto& c = counters();
+    uint64_t hits = c.hits;
+    uint64_t misses = c.misses;
+    return {
+        {"hits", hits},
+        {"misses", misses},
+        {"hit_rate", hits + misses ? double(hits) / (hits + misses) : 0.0},
+        {"max_bytes_held", c.max_bytes_held.load()},
+        {"over_cap", c.over_cap.load()},
+        {"bytes_held", c.bytes_held.load()},
+        {"buffers_held", c.buffers_held.load()},
+    };
+  }
+
+  BufferPool() = default;
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  ~BufferPool() {
+    for (auto& bucket : free_bufs) {
+      for (auto& buf : bucket) {
+        counters().bytes_held -= buf.capacity();
+        counters().buffers_held--;
+      }
+    }
+  }
+
+  // Returns an empty buffer with capacity for at least size bytes.
+  std::string acquire(size_t size) {
+    size_t cls = ceil_log2(size);
+    if (cls <= kMaxClass) {
+      cls = std::max(cls, kMinClass);
+      std::unique_lock<std::mutex> lk{mu};
+      // A buffer one class up is also a good fit.
+      for (size_t c = cls; c <= std::min(cls + 1, kMaxClass); c++) {
+        auto& bucket = free_bufs[c - kMinClass];
+        if (!bucket.empty()) {
+          std::string buf = std::move(bucket.back());
+          bucket.pop_back();
+          lk.unlock();
+          counters().hits++;
+          counters().bytes_held -= buf.capacity();
+          counters().buffers_held--;
+          return buf;
+        }
+      }
+      size = size_t(1) << cls;
+    }
+    counters().misses++;
+    std::string buf;
+    buf.reserve(size);
+    return buf;
+  }
+
+  // Returns a buffer to the pool. Dropped if its bucket is full, or the pools are at their cap.
+  void release(std::string buf) {
+    size_t cap = buf.capacity();
+    size_t cls = floor_log2(cap);
+    if (cls < kMinClass || cls > kMaxClass) {
+      return;
+    }
+
+    // Reserved before the bucket is checked, so concurrent releases can't overshoot the cap.
+    auto& c = counters();
+    if (c.bytes_held.fetch_add(cap) + int64_t(cap) > c.max_bytes_held) {
+      c.bytes_held -= cap;
+      c.over_cap++;
+      return;
+    }
+
+    buf.clear();
+    {
+      std::unique_lock<std::mutex> lk{mu};
+      auto& bucket = free_bufs[cls - kMinClass];
+      if (bucket.size() >= (cls >= kLargeClass ? kPerLargeClass : kPerClass)) {
+        lk.unlock();
+        c.bytes_held -= cap;
+        return;
+      }
+      bucket.push_back(std::move(buf));
+    }
+    c.buffers_held++;
+  }
+
+ private:
+  static size_t floor_log2(size_t n) {
+    return n ? 63 - __builtin_clzll(n) : 0;
+  }
+
+  static size_t ceil_log2(size_t n) {
+    return n > 1 ? floor_log2(n - 1) + 1 : 0;
+  }
+
+  std::mutex mu;
+  std::array<std::vector<std::string>, kMaxClass - kMinClass + 1> free_bufs;
+};
+
+}  // namespace a0::api
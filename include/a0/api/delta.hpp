@@ -0,0 +1,189 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "a0/api/encoders.hpp"
+#include "a0/api/json_string.hpp"
+#include "a0/api/utf8.hpp"
+
+namespace a0::api {
+
+// Writes each payload of a stream as a change to the one written before it.
+//
+// In place of "payload", a frame may carry:
+//   "patch":[...]
+//       An RFC 6902 json patch. Used when both payloads are json, and the
+//       response encoding is "json" or "auto". Changed values are replaced whole.
+//   "delta":[[offset,remove,insert],...]
+//       Splices against the previous payload, in ascending offset order: at
+//       offset, remove that many bytes and insert the given ones. Offsets and
+//       lengths count utf-8 bytes, not characters. insert is encoded like a
+//       payload. Used for other payloads.
+// A full payload is written first, every full_every frames, when requested,
+// and whenever it would be smaller than the change.
+//
+// Used by one A0 thread at a time.
+struct DeltaEncoder {
+  // Unchanged runs shorter than this, between two changes, are folded into one splice.
+  static constexpr size_t kMergeGap = 16;
+
+  // Name of the response encoding.
+  std::string encoding;
+  // 0 to only write full payloads when requested.
+  uint64_t full_every{100};
+  // Set from the event loop, when the client asks.
+  std::atomic<bool> full_requested{false};
+
+  void write_payload(std::string_view payload, const PayloadEncoder& encoder, std::string& out) {
+    std::optional<nlohmann::json> cur_json;
+    if (encoding == "json" || encoding == "auto") {
+      auto parsed = nlohmann::json::parse(payload, nullptr, false);
+      if (!parsed.is_discarded()) {
+        cur_json = std::move(parsed);
+      }
+    }
+
+    bool full = !last ||
+                full_requested.exchange(false) ||
+                (full_every && since_full >= full_every);
+
+    size_t mark = out.size();
+    if (!full && write_change(payload, cur_json, out) && out.size() - mark < payload.size()) {
+      since_full++;
+    } else {
+      out.resize(mark);
+      encoder(payload, out);
+      since_full = 1;
+    }
+
+    last = std::string(payload);
+    last_json = std::move(cur_json);
+  }
+
+ private:
+  struct Splice {
+    // Into the previous payload.
+    size_t offset;
+    size_t remove;
+    // Into the current payload.
+    size_t from;
+    size_t len;
+  };
+
+  static bool continuation(char c) {
+    return (c & 0xC0) == 0x80;
+  }
+
+  // With text, splices start and end on utf-8 character boundaries, so each insert is valid text.
+  static std::vector<Splice> splices(std::string_view prev, std::string_view cur, bool text) {
+    std::vector<Splice> out;
+
+    if (prev.size() != cur.size()) {
+      // One splice, between the common prefix and suffix.
+      size_t p = 0;
+      while (p < prev.size() && p < cur.size() && prev[p] == cur[p]) {
+        p++;
+      }
+      size_t s = 0;
+      while (s < prev.size() - p && s < cur.size() - p &&
+             prev[prev.size() - 1 - s] == cur[cur.size() - 1 - s]) {
+        s++;
+      }
+      // p is cur.size() if cur is a prefix of prev.
+      while (text && p > 0 && p < cur.size() && continuation(cur[p])) {
+        p--;
+      }
+      while (text && s > 0 && continuation(cur[cur.size() - s])) {
+        s--;
+      }
+      out.push_back({p, prev.size() - p - s, p, cur.size() - p - s});
+      return out;
+    }
+
+    // Same size: a splice per changed run, in place.
+    size_t i = 0;
+    while (i < cur.size()) {
+      if (prev[i] == cur[i]) {
+        i++;
+        continue;
+      }
+      size_t begin = i;
+      while (i < cur.size() && prev[i] != cur[i]) {
+        i++;
+      }
+      size_t end = i;
+      while (text && begin > 0 && continuation(cur[begin])) {
+        begin--;
+      }
+      while (text && end < cur.size() && continuation(cur[end])) {
+        end++;
+      }
+      if (!out.empty() && begin <= out.back().offset + out.back().remove + kMergeGap) {
+        out.back().remove = out.back().len = end - out.back().offset;
+      } else {
+        out.push_back({begin, end - begin, begin, end - begin});
+      }
+      i = end;
+    }
+    return out;
+  }
+
+  // Returns false if the change can't be written.
+  bool write_change(std::string_view payload, const std::optional<nlohmann::json>& cur_json, std::string& out) {
+    // Json payloads reach the client as values, not text, so only a patch can change them.
+    if (cur_json || last_json) {
+      if (!cur_json || !last_json) {
+        return false;
+      }
+      out += "\"patch\":";
+      out += nlohmann::json::diff(*last_json, *cur_json).dump();
+      return true;
+    }
+
+    bool text = utf8::valid(payload);
+    bool b64 = encoding == "base64" || (encoding == "auto" && !text);
+    if (!b64 && !text) {
+      return false;
+    }
+
+    out += "\"delta\":[";
+    bool first = true;
+    for (auto&& splice : splices(*last, payload, !b64)) {
+      if (!first) {
+        out.push_back(',');
+      }
+      first = false;
+      out.push_back('[');
+      out += std::to_string(splice.offset);
+      out.push_back(',');
+      out += std::to_string(splice.remove);
+      out.push_back(',');
+      auto insert = payload.substr(splice.from, splice.len);
+      if (b64) {
+        out.push_back('"');
+        base64::encode_to(insert, out);
+        out.push_back('"');
+      } else {
+        write_json_string(insert, out);
+      }
+      out.push_back(']');
+    }
+    out.push_back(']');
+    if (encoding == "auto") {
+      out += b64 ? ",\"encoding\":\"base64\"" : ",\"encoding\":\"none\"";
+    }
+    return true;
+  }
+
+  std::optional<std::string> last;
+  std::optional<nlohmann::json> last_json;
+  uint64_t since_full{0};
+};
+
+}  // namespace a0::api
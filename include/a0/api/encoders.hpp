@@ -1,11 +1,23 @@
 #pragma once
 
+#include <nlohmann/json.hpp>
+
+#include <functional>
 #include <string>
 #include <string_view>
 #include <utility>
 
+#include "a0/api/json_string.hpp"
+#include "a0/api/utf8.hpp"
+
 namespace a0::api {
 
+// Response encoders append the payload members of a json response envelope to `out`:
+//   "payload":<value>
+// optionally followed by a per-packet marker naming the encoding used:
+//   ,"encoding":"<name>"
+using PayloadEncoder = std::function<void(std::string_view, std::string&)>;
+
 namespace none {
 
 A0_STATIC_INLINE
@@ -18,6 +30,12 @@ std::string decode(std::string_view input) {
   return std::string(input);
 }
 
+A0_STATIC_INLINE
+void write_payload(std::string_view input, std::string& out) {
+  out += "\"payload\":";
+  write_json_string(input, out);
+}
+
 }  // namespace none
 
 namespace base64 {
@@ -25,9 +43,11 @@ namespace base64 {
 constexpr std::string_view kCharSet =
     "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
+// Appends the encoding of input to out.
 A0_STATIC_INLINE
-std::string encode(std::string_view input) {
-  std::string out;
+void encode_to(std::string_view input, std::string& out) {
+  size_t start = out.size();
+  out.reserve(start + (input.size() + 2) / 3 * 4);
 
   int a = 0, b = -6;
   for (uint8_t c : input) {
@@ -41,9 +61,15 @@ std::string encode(std::string_view input) {
   if (b > -6) {
     out.push_back(kCharSet[((a << 8) >> (b + 8)) & 0x3F]);
   }
-  while (out.size() % 4) {
+  while ((out.size() - start) % 4) {
     out.push_back('=');
   }
+}
+
+A0_STATIC_INLINE
+std::string encode(std::string_view input) {
+  std::string out;
+  encode_to(input, out);
   return out;
 }
 
@@ -77,16 +103,70 @@ std::string decode(std::string_view input) {
   return out;
 }
 
+A0_STATIC_INLINE
+void write_payload(std::string_view input, std::string& out) {
+  out += "\"payload\":\"";
+  encode_to(input, out);
+  out += '"';
+}
+
 }  // namespace base64
 
+namespace json {
+
+// Whether the payload is a complete json document.
+// Validation runs without building a json tree.
 A0_STATIC_INLINE
-const std::unordered_map<std::string, std::function<std::string(std::string_view)>>& Encoders() {
-  static const std::unordered_map<std::string, std::function<std::string(std::string_view)>>
+bool valid(std::string_view input) {
+  return nlohmann::json::accept(input.begin(), input.end());
+}
+
+// Splices json payloads into the envelope as-is, without re-escaping.
+// Anything else falls back to a json string.
+A0_STATIC_INLINE
+void write_payload(std::string_view input, std::string& out) {
+  if (!valid(input)) {
+    none::write_payload(input, out);
+    return;
+  }
+  out += "\"payload\":";
+  out += input;
+}
+
+}  // namespace json
+
+namespace autodetect {
+
+// Picks the cheapest safe encoding per packet, and marks the packet with it:
+// * json payloads are embedded as-is.
+// * other utf-8 text is sent as a json string.
+// * anything else is base64 encoded.
+A0_STATIC_INLINE
+void write_payload(std::string_view input, std::string& out) {
+  if (json::valid(input)) {
+    json::write_payload(input, out);
+    out += ",\"encoding\":\"json\"";
+  } else if (utf8::valid(input)) {
+    none::write_payload(input, out);
+    out += ",\"encoding\":\"none\"";
+  } else {
+    base64::write_payload(input, out);
+    out += ",\"encoding\":\"base64\"";
+  }
+}
+
+}  // namespace autodetect
+
+A0_STATIC_INLINE
+const std::unordered_map<std::string, PayloadEncoder>& Encoders() {
+  static const std::unordered_map<std::string, PayloadEncoder>
       // Default to base64 for backwards compatability.
       enc = {
-          {"", &none::encode},
-          {"none", &none::encode},
-          {"base64", &base64::encode},
+          {"", &none::write_payload},
+          {"none", &none::write_payload},
+          {"base64", &base64::write_payload},
+          {"json", &json::write_payload},
+          {"auto", &autodetect::write_payload},
       };
   return enc;
 }
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <a0.h>
+
+#include <string>
+#include <string_view>
+
+#include "a0/api/encoders.hpp"
+#include "a0/api/json_string.hpp"
+
+namespace a0::api {
+
+namespace detail {
+
+A0_STATIC_INLINE
+void write_header(std::string_view key, std::string_view val, bool first, std::string& out) {
+  if (!first) {
+    out.push_back(',');
+  }
+  out.push_back('[');
+  write_json_string(key, out);
+  out.push_back(',');
+  write_json_string(val, out);
+  out.push_back(']');
+}
+
+}  // namespace detail
+
+// Appends "headers":[["key","val"],...], read straight from the flat packet.
+A0_STATIC_INLINE
+void write_headers(a0_flat_packet_t fpkt, std::string& out) {
+  out += "\"headers\":[";
+
+  a0_flat_packet_header_iterator_t iter;
+  a0_packet_header_t hdr;
+
+  bool first = true;
+  a0_flat_packet_header_iterator_init(&iter, &fpkt);
+  while (a0_flat_packet_header_iterator_next(&iter, &hdr) == A0_OK) {
+    detail::write_header(hdr.key, hdr.val, first, out);
+    first = false;
+  }
+  out.push_back(']');
+}
+
+A0_STATIC_INLINE
+void write_headers(const Packet& pkt, std::string& out) {
+  out += "\"headers\":[";
+  bool first = true;
+  for (auto&& [key, val] : pkt.headers()) {
+    detail::write_header(key, val, first, out);
+    first = false;
+  }
+  out.push_back(']');
+}
+
+// Capacity to reserve for the envelope of a packet of the given size.
+// Covers base64 expansion, so the common encodings never reallocate.
+A0_STATIC_INLINE
+size_t envelope_size_hint(size_t packet_size) {
+  return packet_size + packet_size / 3 + 256;
+}
+
+// Serializes a response envelope:
+//   {<fields>"headers":[...],<payload members>}
+// `fields` holds any extra pre-serialized members, each followed by a comma.
+// Ex: "\"done\":true,"
+//
+// The packet is read once, directly into `out`. Nothing is copied on the way.
+A0_STATIC_INLINE
+void write_envelope(a0_flat_packet_t fpkt,
+                    std::string_view fields,
+                    const PayloadEncoder& encoder,
+                    std::string& out) {
+  a0_buf_t payload;
+  a0_flat_packet_payload(fpkt, &payload);
+
+  out.push_back('{');
+  out += fields;
+  write_headers(fpkt, out);
+  out.push_back(',');
+  encoder(std::string_view((const char*)payload.data, payload.size), out);
+  out.push_back('}');
+}
+
+A0_STATIC_INLINE
+void write_envelope(const Packet& pkt,
+                    std::string_view fields,
+                    const PayloadEncoder& encoder,
+                    std::string& out) {
+  out.push_back('{');
+  out += fields;
+  write_headers(pkt, out);
+  out.push_back(',');
+  encoder(pkt.payload(), out);
+  out.push_back('}');
+}
+
+A0_STATIC_INLINE
+std::string envelope(const Packet& pkt,
+                     std::string_view fields,
+                     const PayloadEncoder& encoder) {
+  std::string out;
+  out.reserve(envelope_size_hint(pkt.payload().size()));
+  write_envelope(pkt, fields, encoder, out);
+  return out;
+}
+
+}  // namespace a0::api
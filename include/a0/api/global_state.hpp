@@ -3,15 +3,22 @@
 #include <App.h>
 #include <signal.h>
 
+#include <thread>
+#include <vector>
+
+#include "a0/api/ws_registry.hpp"
+
 namespace a0::api {
 
 struct GlobalState {
   uWS::Loop* event_loop;
+  std::thread::id event_loop_thread;
   // The following can be used anywhere.
   std::atomic<bool> running;
   // The following should only be used within the event_loop.
-  us_listen_socket_t* listen_socket;
-  std::set<uWS::AsyncSocket<false>*> active_ws;
+  // TCP, and optionally a unix domain socket.
+  std::vector<us_listen_socket_t*> listen_sockets;
+  WSRegistry active_ws;
   // The following should only be used to lock alephzero threads.
   std::mutex mu;
   std::condition_variable cv;
@@ -32,13 +39,13 @@ GlobalState* global() {
 void shutdown() {
   global()->running = false;
   global()->event_loop->defer([]() {
-    if (global()->listen_socket) {
-      us_listen_socket_close(0, global()->listen_socket);
-      global()->listen_socket = nullptr;
+    for (auto* listen_socket : global()->listen_sockets) {
+      us_listen_socket_close(0, listen_socket);
     }
-    for (auto* ws : global()->active_ws) {
+    global()->listen_sockets.clear();
+    global()->active_ws.for_each([](WSHandle, auto* ws) {
       ((uWS::WebSocket<false, true, void>*)ws)->close();
-    }
+    });
   });
 }
 
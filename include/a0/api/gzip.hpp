@@ -0,0 +1,99 @@
+#pragma once
+
+#include <zlib.h>
+
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "a0/api/strutil.hpp"
+
+namespace a0::api {
+
+// Streaming gzip compression, over zlib.
+// Output is handed to the sink in bounded pieces, as it is produced.
+struct GzipDeflate {
+  static constexpr size_t kChunk = 64 * 1024;
+
+  explicit GzipDeflate(int level = Z_BEST_SPEED) {
+    // 15 + 16: largest window, with a gzip header and trailer.
+    if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+      throw std::runtime_error("Failed to initialize gzip.");
+    }
+  }
+  ~GzipDeflate() { deflateEnd(&zs); }
+  GzipDeflate(const GzipDeflate&) = delete;
+  GzipDeflate& operator=(const GzipDeflate&) = delete;
+
+  // With finish, also writes the end of the stream.
+  void write(std::string_view in, bool finish, const std::function<void(std::string_view)>& sink) {
+    zs.next_in = (Bytef*)in.data();
+    zs.avail_in = in.size();
+    char out[kChunk];
+    int ret;
+    do {
+      zs.next_out = (Bytef*)out;
+      zs.avail_out = kChunk;
+      ret = deflate(&zs, finish ? Z_FINISH : Z_NO_FLUSH);
+      if (ret == Z_STREAM_ERROR) {
+        throw std::runtime_error("Failed to gzip.");
+      }
+      if (zs.avail_out != kChunk) {
+        sink(std::string_view(out, kChunk - zs.avail_out));
+      }
+    } while (zs.avail_out == 0 || (finish && ret != Z_STREAM_END));
+  }
+
+ private:
+  z_stream zs{};
+};
+
+// Streaming gzip decompression, over zlib.
+// Output is handed to the sink in bounded pieces, so a small input can't expand in memory.
+struct GzipInflate {
+  static constexpr size_t kChunk = 64 * 1024;
+
+  GzipInflate() {
+    // 15 + 32: largest window, detecting a gzip or zlib header.
+    if (inflateInit2(&zs, 15 + 32) != Z_OK) {
+      throw std::runtime_error("Failed to initialize gunzip.");
+    }
+  }
+  ~GzipInflate() { inflateEnd(&zs); }
+  GzipInflate(const GzipInflate&) = delete;
+  GzipInflate& operator=(const GzipInflate&) = delete;
+
+  bool finished() const { return ended; }
+
+  void write(std::string_view in, const std::function<void(std::string_view)>& sink) {
+    zs.next_in = (Bytef*)in.data();
+    zs.avail_in = in.size();
+    char out[kChunk];
+    while (!ended) {
+      zs.next_out = (Bytef*)out;
+      zs.avail_out = kChunk;
+      int ret = inflate(&zs, Z_NO_FLUSH);
+      if (ret == Z_BUF_ERROR) {
+        // Needs more input.
+        return;
+      }
+      if (ret != Z_OK && ret != Z_STREAM_END) {
+        throw std::invalid_argument(strutil::cat("Invalid gzip body: ", zs.msg ? zs.msg : "corrupt data"));
+      }
+      if (zs.avail_out != kChunk) {
+        sink(std::string_view(out, kChunk - zs.avail_out));
+      }
+      ended = ret == Z_STREAM_END;
+      if (!zs.avail_in && zs.avail_out) {
+        return;
+      }
+    }
+  }
+
+ private:
+  z_stream zs{};
+  bool ended{false};
+};
+
+}  // namespace a0::api
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <a0.h>
+#include <nlohmann/json.hpp>
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "a0/api/strutil.hpp"
+
+namespace a0::api {
+
+// Predicate over packet headers, compiled from the "filter" request field.
+//
+// Leaves test a single header key:
+//   {"key": "source", "eq": "lidar_front"}
+//   {"key": "source", "prefix": "lidar"}
+//   {"key": "a0_deps", "exists": true}
+// and are combined with:
+//   {"and": [...]}
+//   {"or": [...]}
+//
+// All leaves are tested in a single pass over the headers, so evaluating a
+// filter costs one header scan regardless of its shape.
+struct HeaderFilter {
+  static constexpr size_t kMaxLeaves = 64;
+
+  enum struct op_t {
+    EQ,
+    PREFIX,
+    EXISTS,
+    AND,
+    OR,
+  };
+
+  struct Leaf {
+    op_t op;
+    std::string key;
+    std::string val;
+  };
+
+  struct Node {
+    op_t op;
+    // Leaves: index into leaves. Branches: indices into nodes.
+    size_t leaf{0};
+    std::vector<size_t> children;
+    // Only meaningful for EXISTS leaves.
+    bool expect{true};
+  };
+
+  std::vector<Leaf> leaves;
+  std::vector<Node> nodes;
+  size_t root{0};
+
+  static HeaderFilter Parse(const nlohmann::json& spec) {
+    HeaderFilter filter;
+    filter.root = filter.compile(spec);
+    return filter;
+  }
+
+  bool match(a0_flat_packet_t fpkt) const {
+    uint64_t hits = 0;
+
+    a0_flat_packet_header_iterator_t iter;
+    a0_packet_header_t hdr;
+
+    a0_flat_packet_header_iterator_init(&iter, &fpkt);
+    while (a0_flat_packet_header_iterator_next(&iter, &hdr) == A0_OK) {
+      hits |= scan(hdr.key, hdr.val);
+    }
+    return eval(root, hits);
+  }
+
+  bool match(const Packet& pkt) const {
+    uint64_t hits = 0;
+    for (auto&& [key, val] : pkt.headers()) {
+      hits |= scan(key, val);
+    }
+    return eval(root, hits);
+  }
+
+ private:
+  // Returns the bitmask of leaves satisfied by the given header.
+  uint64_t scan(std::string_view key, std::string_view val) const {
+    uint64_t hits = 0;
+    for (size_t i = 0; i < leaves.size(); i++) {
+      const auto& leaf = leaves[i];
+      if (leaf.key != key) {
+        continue;
+      }
+      bool hit = false;
+      switch (leaf.op) {
+        case op_t::EQ:
+          hit = val == leaf.val;
+          break;
+        case op_t::PREFIX:
+          hit = val.substr(0, leaf.val.size()) == leaf.val;
+          break;
+        default:
+          hit = true;
+          break;
+      }
+      if (hit) {
+        hits |= uint64_t(1) << i;
+      }
+    }
+    return hits;
+  }
+
+  bool eval(size_t idx, uint64_t hits) const {
+    const auto& node = nodes[idx];
+    switch (node.op) {
+      case op_t::AND:
+        for (auto child : node.children) {
+          if (!eval(child, hits)) {
+            return false;
+          }
+        }
+        return true;
+      case op_t::OR:
+        for (auto child : node.children) {
+          if (eval(child, hits)) {
+            return true;
+          }
+        }
+        return false;
+      default:
+        return bool(hits & (uint64_t(1) << node.leaf)) == node.expect;
+    }
+  }
+
+  size_t compile(const nlohmann::json& spec) {
+    if (!spec.is_object()) {
+      throw std::invalid_argument("Invalid filter: each clause must be a json object.");
+    }
+
+    Node node;
+    if (spec.contains("and") || spec.contains("or")) {
+      node.op = spec.contains("and") ? op_t::AND : op_t::OR;
+      const auto& clauses = spec.at(node.op == op_t::AND ? "and" : "or");
+      if (!clauses.is_array()) {
+        throw std::invalid_argument("Invalid filter: 'and' and 'or' take a list of clauses.");
+      }
+      for (const auto& clause : clauses) {
+        node.children.push_back(compile(clause));
+      }
+    } else {
+      if (!spec.contains("key") || !spec.at("key").is_string()) {
+        throw std::invalid_argument("Invalid filter: clause requires a string 'key'.");
+      }
+      if (leaves.size() == kMaxLeaves) {
+        throw std::invalid_argument(strutil::cat("Invalid filter: at most ", kMaxLeaves, " key clauses allowed."));
+      }
+
+      Leaf leaf;
+      leaf.key = spec.at("key").get<std::string>();
+      if (spec.contains("eq")) {
+        leaf.op = op_t::EQ;
+        leaf.val = require_string(spec, "eq");
+      } else if (spec.contains("prefix")) {
+        leaf.op = op_t::PREFIX;
+        leaf.val = require_string(spec, "prefix");
+      } else if (spec.contains("exists")) {
+        leaf.op = op_t::EXISTS;
+        if (!spec.at("exists").is_boolean()) {
+          throw std::invalid_argument("Invalid filter: 'exists' must be a boolean.");
+        }
+        node.expect = spec.at("exists").get<bool>();
+      } else {
+        throw std::invalid_argument("Invalid filter: clause requires one of 'eq', 'prefix', 'exists'.");
+      }
+
+      node.op = leaf.op;
+      node.leaf = leaves.size();
+      leaves.push_back(std::move(leaf));
+    }
+
+    nodes.push_back(std::move(node));
+    return nodes.size() - 1;
+  }
+
+  static std::string require_string(const nlohmann::json& spec, const char* field) {
+    if (!spec.at(field).is_string()) {
+      throw std::invalid_argument(strutil::cat("Invalid filter: '", field, "' must be a string."));
+    }
+    return spec.at(field).get<std::string>();
+  }
+};
+
+}  // namespace a0::api
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <a0.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "a0/api/strutil.hpp"
+#include "a0/api/utf8.hpp"
+
+namespace a0::api {
+
+namespace detail {
+
+// Builds the error nlohmann::json::dump() reports for the invalid utf-8
+// sequence starting at data[i]: the first byte that cannot continue it.
+A0_STATIC_INLINE
+std::string invalid_utf8_message(const uint8_t* data, size_t i, size_t size) {
+  uint8_t lead = data[i];
+  size_t bad = i;
+  if (lead >= 0xC2 && lead <= 0xF4) {
+    size_t len = lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+    uint8_t lo = lead == 0xE0 ? 0xA0 : lead == 0xF0 ? 0x90 : 0x80;
+    uint8_t hi = lead == 0xED ? 0x9F : lead == 0xF4 ? 0x8F : 0xBF;
+    bad = i + 1;
+    while (bad < size && bad < i + len) {
+      uint8_t c = data[bad];
+      bool ok = bad == i + 1 ? (c >= lo && c <= hi) : ((c & 0xC0) == 0x80);
+      if (!ok) {
+        break;
+      }
+      bad++;
+    }
+    if (bad == size) {
+      return strutil::fmt("[json.exception.type_error.316] incomplete UTF-8 string; last byte: 0x%.2X",
+                          data[size - 1]);
+    }
+  }
+  return strutil::fmt("[json.exception.type_error.316] invalid UTF-8 byte at index %zu: 0x%.2X",
+                      bad, data[bad]);
+}
+
+}  // namespace detail
+
+// Appends the input as a quoted json string.
+// Output and errors match nlohmann::json::dump(), without building a json value.
+// Runs of bytes that need no escaping are copied in one go.
+A0_STATIC_INLINE
+void write_json_string(std::string_view input, std::string& out) {
+  static constexpr char kHex[] = "0123456789abcdef";
+
+  auto* data = (const uint8_t*)input.data();
+  size_t size = input.size();
+
+  out.reserve(out.size() + size + 2);
+  out.push_back('"');
+
+  size_t i = 0;
+  while (i < size) {
+    size_t run = i;
+    while (run < size && data[run] >= 0x20 && data[run] < 0x80 && data[run] != '"' && data[run] != '\\') {
+      run++;
+    }
+    out.append((const char*)data + i, run - i);
+    i = run;
+    if (i == size) {
+      break;
+    }
+
+    uint8_t c = data[i];
+    if (c >= 0x80) {
+      size_t len = utf8::detail::sequence_length(data, i, size);
+      if (!len) {
+        throw std::invalid_argument(detail::invalid_utf8_message(data, i, size));
+      }
+      out.append((const char*)data + i, len);
+      i += len;
+      continue;
+    }
+
+    switch (c) {
+      case '"':
+        out += "\\\"";
+        break;
+      case '\\':
+        out += "\\\\";
+        break;
+      case '\b':
+        out += "\\b";
+        break;
+      case '\f':
+        out += "\\f";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      case '\r':
+        out += "\\r";
+        break;
+      case '\t':
+        out += "\\t";
+        break;
+      default:
+        out += "\\u00";
+        out.push_back(kHex[c >> 4]);
+        out.push_back(kHex[c & 0xF]);
+        break;
+    }
+    i++;
+  }
+
+  out.push_back('"');
+}
+
+}  // namespace a0::api
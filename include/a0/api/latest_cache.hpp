@@ -0,0 +1,182 @@
+#pragma once
+
+#include <a0.h>
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "a0/api/global_state.hpp"
+#include "a0/api/loop_watchdog.hpp"
+#include "a0/api/timers.hpp"
+
+namespace a0::api {
+
+// Most recent packet of each watched topic.
+//
+// A topic is watched from its first lookup, by a subscriber that skips to the
+// newest packet. Topics that go unread for kIdleMs are dropped.
+// Only used within the event loop, except where noted.
+struct LatestCache {
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr uint64_t kIdleMs = 60 * 1000;
+  // A new subscriber needs a moment to find a topic's existing packets.
+  static constexpr uint64_t kFillMs = 100;
+
+  struct Snapshot {
+    // Transport sequence number of the packet. 0 if the topic has none yet.
+    uint64_t seq{0};
+    // The packet, as stored in the transport.
+    std::shared_ptr<const std::string> flat;
+    // The subscriber may not have caught up with the topic yet.
+    bool filling{false};
+
+    a0_flat_packet_t fpkt() const {
+      return a0_flat_packet_t{{(uint8_t*)flat->data(), flat->size()}};
+    }
+  };
+
+  struct Entry {
+    // Guards snap. Used from the subscriber thread.
+    std::mutex mu;
+    Snapshot snap;
+
+    Clock::time_point created;
+    Clock::time_point last_used;
+    std::map<uint64_t, std::function<void()>> waiters;
+    // Size of waiters, for the subscriber thread. Packets aren't announced without any.
+    std::atomic<size_t> num_waiters{0};
+
+    // Declared last, so it stops before the rest is freed.
+    std::unique_ptr<SubscriberZeroCopy> sub;
+  };
+
+  static LatestCache* get() {
+    static LatestCache cache;
+    return &cache;
+  }
+
+  // Starts watching the topic, if needed.
+  // Throws if the topic name is invalid.
+  Snapshot lookup(const std::string& topic) {
+    auto* entry = watch(topic);
+    entry->last_used = Clock::now();
+
+    Snapshot snap;
+    {
+      std::unique_lock<std::mutex> lk{entry->mu};
+      snap = entry->snap;
+    }
+    snap.filling = !snap.flat && entry->last_used - entry->created < std::chrono::milliseconds(kFillMs);
+    return snap;
+  }
+
+  // Calls fn each time the topic gets a new packet, until removed.
+  // The topic must have been looked up.
+  void add_waiter(const std::string& topic, uint64_t id, std::function<void()> fn) {
+    auto* entry = entries.at(topic).get();
+    entry->waiters[id] = std::move(fn);
+    if (entry->num_waiters.exchange(entry->waiters.size()) == 0) {
+      // A packet stored since the caller's lookup may not have been announced.
+      defer("latest_cache", [topic]() { get()->notify(topic); });
+    }
+  }
+
+  void remove_waiter(const std::string& topic, uint64_t id) {
+    auto it = entries.find(topic);
+    if (it != entries.end()) {
+      it->second->waiters.erase(id);
+      it->second->num_waiters = it->second->waiters.size();
+    }
+  }
+
+  void clear() {
+    entries.clear();
+  }
+
+  nlohmann::json stats() const {
+    size_t waiters = 0;
+    for (auto&& [topic, entry] : entries) {
+      waiters += entry->waiters.size();
+    }
+    return {
+        {"topics", entries.size()},
+        {"waiters", waiters},
+    };
+  }
+
+ private:
+  Entry* watch(const std::string& topic) {
+    auto it = entries.find(topic);
+    if (it != entries.end()) {
+      return it->second.get();
+    }
+
+    auto entry = std::make_unique<Entry>();
+    entry->created = Clock::now();
+    // Runs on A0 thread.
+    entry->sub = std::make_unique<SubscriberZeroCopy>(
+        topic, INIT_MOST_RECENT, ITER_NEWEST,
+        [entry = entry.get(), topic](TransportLocked tlk, FlatPacket fpkt) {
+          if (!global()->running) {
+            return;
+          }
+          Snapshot snap;
+          snap.seq = tlk.frame().hdr.seq;
+          snap.flat = std::make_shared<const std::string>((char*)fpkt.c->buf.data, fpkt.c->buf.size);
+          {
+            std::unique_lock<std::mutex> lk{entry->mu};
+            entry->snap = std::move(snap);
+          }
+          // Most packets on a busy topic have no one waiting.
+          if (entry->num_waiters) {
+            defer("latest_cache", [topic]() { get()->notify(topic); });
+          }
+        });
+
+    auto* ptr = entry.get();
+    entries[topic] = std::move(entry);
+    if (entries.size() == 1) {
+      schedule_sweep();
+    }
+    return ptr;
+  }
+
+  void notify(const std::string& topic) {
+    auto it = entries.find(topic);
+    if (it == entries.end()) {
+      return;
+    }
+    // Waiters may remove themselves.
+    auto waiters = it->second->waiters;
+    for (auto&& [id, fn] : waiters) {
+      fn();
+    }
+  }
+
+  void schedule_sweep() {
+    Timers::get()->after(kIdleMs, [this]() {
+      auto cutoff = Clock::now() - std::chrono::milliseconds(kIdleMs);
+      for (auto it = entries.begin(); it != entries.end();) {
+        if (it->second->waiters.empty() && it->second->last_used < cutoff) {
+          it = entries.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      if (!entries.empty()) {
+        schedule_sweep();
+      }
+    });
+  }
+
+  std::map<std::string, std::unique_ptr<Entry>> entries;
+};
+
+}  // namespace a0::api
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <a0.h>
+#include <nlohmann/json.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "a0/api/strutil.hpp"
+
+namespace a0::api {
+
+// Text and time predicate over log packets, compiled from the "query" request field:
+//   {
+//     "text": "...",          substring of the payload
+//     "ignore_case": false,
+//     "since": "...",         a0_time_wall at or after. Same format as the header
+//     "until": "...",         a0_time_wall before
+//     "limit": 0,             stop after this many matches. 0 for no limit
+//   }
+// All fields are optional.
+//
+// Cheap tests run first: the time window, then the substring scan.
+// There's no regex: a client's pattern could backtrack without bound, or
+// overflow the stack, on the A0 thread.
+struct LogQuery {
+  std::string text;
+  bool ignore_case{false};
+  std::optional<int64_t> since_ns;
+  std::optional<int64_t> until_ns;
+  uint64_t limit{0};
+
+  static LogQuery Parse(const nlohmann::json& spec) {
+    if (!spec.is_object()) {
+      throw std::invalid_argument("Invalid query: must be an object.");
+    }
+
+    LogQuery query;
+    try {
+      if (spec.contains("ignore_case")) {
+        spec.at("ignore_case").get_to(query.ignore_case);
+      }
+      if (spec.contains("text")) {
+        spec.at("text").get_to(query.text);
+      }
+      if (spec.contains("regex")) {
+        throw std::invalid_argument("Invalid query: regex isn't supported. Use text.");
+      }
+      if (spec.contains("since")) {
+        query.since_ns = parse_time(spec.at("since").get<std::string>());
+      }
+      if (spec.contains("until")) {
+        query.until_ns = parse_time(spec.at("until").get<std::string>());
+      }
+      if (spec.contains("limit")) {
+        spec.at("limit").get_to(query.limit);
+      }
+    } catch (std::invalid_argument&) {
+      throw;
+    } catch (std::exception& e) {
+      throw std::invalid_argument(strutil::cat("Invalid query: ", e.what()));
+    }
+    return query;
+  }
+
+  // a0_time_wall_str format, to nanoseconds since the epoch.
+  static int64_t parse_time(const std::string& str) {
+    a0_time_wall_t wall;
+    if (a0_time_wall_parse(str.c_str(), &wall) != A0_OK) {
+      throw std::invalid_argument(strutil::cat("Invalid query: unparsable time: ", str));
+    }
+    return int64_t(wall.ts.tv_sec) * 1000000000 + wall.ts.tv_nsec;
+  }
+
+  // The a0_time_wall header value, or nullptr if missing.
+  bool match_time(const char* wall) const {
+    if (!since_ns && !until_ns) {
+      return true;
+    }
+    if (!wall) {
+      return false;
+    }
+    a0_time_wall_t parsed;
+    if (a0_time_wall_parse(wall, &parsed) != A0_OK) {
+      return false;
+    }
+    int64_t ns = int64_t(parsed.ts.tv_sec) * 1000000000 + parsed.ts.tv_nsec;
+    return (!since_ns || ns >= *since_ns) && (!until_ns || ns < *until_ns);
+  }
+
+  bool match_payload(std::string_view payload) const {
+    return text.empty() || find(payload, text, ignore_case) != std::string_view::npos;
+  }
+
+  // Index of the first occurrence of needle in hay, or npos.
+  //
+  // Tests the needle's first and last bytes at 16 positions at once, and only
+  // compares the whole needle where both match. With ignore_case, letters are
+  // compared with their case bit set, which may let through a few non-letters
+  // that the full compare then rejects.
+  static size_t find(std::string_view hay, std::string_view needle, bool ignore_case) {
+    size_t n = needle.size();
+    if (n == 0) {
+      return 0;
+    }
+    if (hay.size() < n) {
+      return std::string_view::npos;
+    }
+
+    auto fold_bit = [ignore_case](char c) -> uint8_t {
+      return ignore_case && ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') ? 0x20 : 0;
+    };
+    uint8_t first_bit = fold_bit(needle[0]);
+    uint8_t last_bit = fold_bit(needle[n - 1]);
+    uint8_t first = needle[0] | first_bit;
+    uint8_t last = needle[n - 1] | last_bit;
+
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i first_v = _mm_set1_epi8(first);
+    const __m128i last_v = _mm_set1_epi8(last);
+    const __m128i first_bit_v = _mm_set1_epi8(first_bit);
+    const __m128i last_bit_v = _mm_set1_epi8(last_bit);
+    for (; i + n - 1 + 16 <= hay.size(); i += 16) {
+      __m128i a = _mm_or_si128(_mm_loadu_si128((const __m128i*)(hay.data() + i)), first_bit_v);
+      __m128i b = _mm_or_si128(_mm_loadu_si128((const __m128i*)(hay.data() + i + n - 1)), last_bit_v);
+      unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first_v), _mm_cmpeq_epi8(b, last_v)));
+      while (mask) {
+        size_t pos = i + __builtin_ctz(mask);
+        if (equal(hay.data() + pos, needle, ignore_case)) {
+          return pos;
+        }
+        mask &= mask - 1;
+      }
+    }
+#endif
+    for (; i + n <= hay.size(); i++) {
+      if (uint8_t(hay[i] | first_bit) == first && equal(hay.data() + i, needle, ignore_case)) {
+        return i;
+      }
+    }
+    return std::string_view::npos;
+  }
+
+ private:
+  static bool equal(const char* data, std::string_view needle, bool ignore_case) {
+    if (!ignore_case) {
+      return memcmp(data, needle.data(), needle.size()) == 0;
+    }
+    for (size_t i = 0; i < needle.size(); i++) {
+      if (std::tolower((uint8_t)data[i]) != std::tolower((uint8_t)needle[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+}  // namespace a0::api
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <App.h>
+#include <a0.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+
+#include "a0/api/global_state.hpp"
+#include "a0/api/strutil.hpp"
+#include "a0/api/timers.hpp"
+
+namespace a0::api {
+
+// Watches for work that blocks the event loop.
+//
+// A timer ticks every kTickMs, and records how late each tick runs: the loop lag.
+// REST handlers and deferred tasks are timed as they run, by name. Anything
+// slower than threshold_ms is logged, along with its name.
+//
+// Only used within the event loop, except for the deferred task counters.
+struct LoopWatchdog {
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr uint64_t kTickMs = 100;
+
+  // Durations, in buckets of doubling width: under 1ms, under 2ms, ... under 1024ms, and the rest.
+  struct Histogram {
+    static constexpr size_t kBuckets = 12;
+
+    std::array<uint64_t, kBuckets> buckets{};
+    uint64_t count{0};
+    double total_ms{0};
+    double max_ms{0};
+
+    void add(double ms) {
+      size_t bucket = 0;
+      while (bucket + 1 < kBuckets && ms >= double(uint64_t(1) << bucket)) {
+        bucket++;
+      }
+      buckets[bucket]++;
+      count++;
+      total_ms += ms;
+      max_ms = std::max(max_ms, ms);
+    }
+
+    nlohmann::json stats() const {
+      auto le_ms = nlohmann::json::array();
+      for (size_t i = 0; i < kBuckets; i++) {
+        le_ms.push_back(i + 1 < kBuckets ? nlohmann::json(uint64_t(1) << i) : nlohmann::json(nullptr));
+      }
+      return {
+          {"count", count},
+          {"mean_ms", count ? total_ms / count : 0.0},
+          {"max_ms", max_ms},
+          {"le_ms", le_ms},
+          {"buckets", buckets},
+      };
+    }
+  };
+
+  uint64_t threshold_ms{50};
+
+  Histogram lag;
+  std::map<std::string, Histogram> handlers;
+  uint64_t slow{0};
+
+  // The REST route whose handler is running, if any. Set by watched, so
+  // request bodies handled later are timed under the same name.
+  const char* route{nullptr};
+
+  // Deferred tasks waiting to run. Counted from any thread.
+  std::atomic<int64_t> deferred_depth{0};
+  std::atomic<int64_t> deferred_max_depth{0};
+
+  static LoopWatchdog* get() {
+    static LoopWatchdog watchdog;
+    return &watchdog;
+  }
+
+  // Starts the lag timer.
+  void start() {
+    tick(Clock::now() + std::chrono::milliseconds(kTickMs));
+  }
+
+  // Runs fn, and records how long it took under the given name.
+  template <typename Fn>
+  void time(const char* name, Fn&& fn) {
+    auto start = Clock::now();
+    fn();
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    handlers[name].add(ms);
+    if (ms >= threshold_ms) {
+      slow++;
+      strutil::log(strutil::fmt("Event loop blocked by %s for %.1f ms", name, ms));
+    }
+  }
+
+  // Safe to call from any thread.
+  void deferred_queued() {
+    int64_t depth = ++deferred_depth;
+    int64_t max_depth = deferred_max_depth;
+    while (depth > max_depth && !deferred_max_depth.compare_exchange_weak(max_depth, depth)) {
+    }
+  }
+
+  void deferred_ran() {
+    deferred_depth--;
+  }
+
+  nlohmann::json stats() const {
+    nlohmann::json handler_stats = nlohmann::json::object();
+    for (const auto& [name, hist] : handlers) {
+      handler_stats[name] = hist.stats();
+    }
+    return {
+        {"threshold_ms", threshold_ms},
+        {"slow", slow},
+        {"lag", lag.stats()},
+        {"deferred",
+         {
+             {"depth", deferred_depth.load()},
+             {"max_depth", deferred_max_depth.load()},
+         }},
+        {"handlers", handler_stats},
+    };
+  }
+
+ private:
+  void tick(Clock::time_point expected) {
+    Timers::get()->after(kTickMs, [this, expected]() {
+      if (!global()->running) {
+        return;
+      }
+      auto now = Clock::now();
+      double ms = std::max(0.0, std::chrono::duration<double, std::milli>(now - expected).count());
+      lag.add(ms);
+      if (ms >= threshold_ms) {
+        strutil::log(strutil::fmt("Event loop lagged by %.1f ms", ms));
+      }
+      tick(now + std::chrono::milliseconds(kTickMs));
+    });
+  }
+};
+
+// Runs fn on the event loop, timed under the given name. Safe to call from any thread.
+A0_STATIC_INLINE
+void defer(const char* name, std::function<void()> fn) {
+  LoopWatchdog::get()->deferred_queued();
+  global()->event_loop->defer([name, fn = std::move(fn)]() {
+    auto* watchdog = LoopWatchdog::get();
+    watchdog->deferred_ran();
+    watchdog->time(name, fn);
+  });
+}
+
+// Wraps a REST handler, to time it under the given name.
+// Body callbacks registered with watched_route are timed under it too.
+template <typename Handler>
+auto watched(const char* name, Handler handler) {
+  return [name, handler](uWS::HttpResponse<false>* res, uWS::HttpRequest* req) {
+    auto* watchdog = LoopWatchdog::get();
+    watchdog->route = name;
+    watchdog->time(name, [&]() { handler(res, req); });
+    watchdog->route = nullptr;
+  };
+}
+
+// Wraps a callback that runs later for the current route, such as a request
+// body handler, to time it under the route's name.
+template <typename Fn>
+auto watched_route(Fn fn) {
+  return [name = LoopWatchdog::get()->route, fn = std::move(fn)](auto&&... args) mutable {
+    if (!name) {
+      return fn(std::forward<decltype(args)>(args)...);
+    }
+    LoopWatchdog::get()->time(name, [&]() { fn(std::forward<decltype(args)>(args)...); });
+  };
+}
+
+}  // namespace a0::api
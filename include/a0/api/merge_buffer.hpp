@@ -0,0 +1,183 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "a0/api/strutil.hpp"
+
+namespace a0::api {
+
+// Reorder buffer for the frames of several topics, keyed by their a0_time_mono.
+//
+// ORDERED: a k-way merge. The earliest head is sent once every topic has a
+//   frame queued, or once it has waited out the window since it arrived, or
+//   when the buffer is full. The window counts from arrival, so history and
+//   late packets are merged too. Assumes each topic's own frames arrive in time order.
+// SYNC: tuples, one frame per topic, whose times are within the tolerance.
+//   A head that can no longer be part of a tuple is dropped.
+//
+// Shared by the topics' A0 threads and the event loop.
+//
+// send may block, throttled by the outbound budget, until the event loop
+// writes out earlier frames. So it's never called under the lock. Merged
+// frames are queued in order, and sent by whichever thread gets to them first.
+struct MergeBuffer {
+  enum class Mode { ORDERED, SYNC };
+
+  struct Item {
+    int64_t time_ns;
+    std::string frame;
+    // Set by push.
+    int64_t arrival_ns{0};
+  };
+
+  Mode mode{Mode::ORDERED};
+  int64_t window_ns{0};
+  int64_t tolerance_ns{0};
+  size_t max_buffer{0};
+  std::vector<std::string> topics;
+  std::function<void(std::string)> send;
+  std::function<void(std::string)> release;
+
+  void init(std::vector<std::string> topics_) {
+    topics = std::move(topics_);
+    queues.resize(topics.size());
+  }
+
+  // Returns true if anything was merged.
+  bool push(size_t idx, Item item, int64_t now_ns) {
+    std::unique_lock<std::mutex> lk{mu};
+    auto& queue = queues[idx];
+    if (mode == Mode::SYNC && queue.size() >= max_buffer) {
+      release(std::move(queue.front().frame));
+      queue.pop_front();
+      total--;
+      dropped++;
+    }
+    item.arrival_ns = now_ns;
+    queue.push_back(std::move(item));
+    total++;
+    bool merged = mode == Mode::ORDERED ? flush_ordered(now_ns) : flush_sync();
+    deliver(lk);
+    return merged;
+  }
+
+  // Sends heads that have waited out the window.
+  // Runs on the event loop. Never blocks on a throttled send.
+  bool tick(int64_t now_ns) {
+    std::unique_lock<std::mutex> lk{mu};
+    bool merged = mode == Mode::ORDERED && flush_ordered(now_ns);
+    deliver(lk);
+    return merged;
+  }
+
+  uint64_t dropped_count() {
+    std::unique_lock<std::mutex> lk{mu};
+    return dropped;
+  }
+
+ private:
+  // Sends the ready frames, in order, with the lock released.
+  // If another thread is already sending, leaves them to it.
+  void deliver(std::unique_lock<std::mutex>& lk) {
+    if (sending) {
+      return;
+    }
+    sending = true;
+    while (!ready.empty()) {
+      std::string frame = std::move(ready.front());
+      ready.pop_front();
+      lk.unlock();
+      send(std::move(frame));
+      lk.lock();
+    }
+    sending = false;
+  }
+
+  bool flush_ordered(int64_t now_ns) {
+    bool sent = false;
+    while (total) {
+      size_t best = queues.size();
+      bool all_queued = true;
+      for (size_t i = 0; i < queues.size(); i++) {
+        if (queues[i].empty()) {
+          all_queued = false;
+        } else if (best == queues.size() || queues[i].front().time_ns < queues[best].front().time_ns) {
+          best = i;
+        }
+      }
+      auto& head = queues[best].front();
+      if (!all_queued && head.arrival_ns > now_ns - window_ns && total <= max_buffer) {
+        // A quiet topic may still have an earlier frame on the way.
+        break;
+      }
+      ready.push_back(std::move(head.frame));
+      queues[best].pop_front();
+      total--;
+      sent = true;
+    }
+    return sent;
+  }
+
+  bool flush_sync() {
+    bool sent = false;
+    while (true) {
+      size_t lo = 0;
+      size_t hi = 0;
+      for (size_t i = 0; i < queues.size(); i++) {
+        if (queues[i].empty()) {
+          return sent;
+        }
+        if (queues[i].front().time_ns < queues[lo].front().time_ns) {
+          lo = i;
+        }
+        if (queues[i].front().time_ns > queues[hi].front().time_ns) {
+          hi = i;
+        }
+      }
+
+      int64_t skew_ns = queues[hi].front().time_ns - queues[lo].front().time_ns;
+      if (skew_ns > tolerance_ns) {
+        // Later frames of the hi topic are further still, so the lo head can't be matched.
+        release(std::move(queues[lo].front().frame));
+        queues[lo].pop_front();
+        total--;
+        dropped++;
+        continue;
+      }
+
+      std::string out = "{\"topics\":{";
+      for (size_t i = 0; i < queues.size(); i++) {
+        if (i) {
+          out.push_back(',');
+        }
+        out += nlohmann::json(topics[i]).dump();
+        out.push_back(':');
+        out += queues[i].front().frame;
+        release(std::move(queues[i].front().frame));
+        queues[i].pop_front();
+        total--;
+      }
+      out += strutil::cat("},\"skew_ms\":", nlohmann::json(skew_ns / 1e6).dump(), "}");
+      ready.push_back(std::move(out));
+      sent = true;
+    }
+  }
+
+  std::mutex mu;
+  std::vector<std::deque<Item>> queues;
+  size_t total{0};
+  uint64_t dropped{0};
+  // Merged frames, waiting to be sent.
+  std::deque<std::string> ready;
+  // Set while a thread is sending the ready frames.
+  bool sending{false};
+};
+
+}  // namespace a0::api
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace a0::api {
+
+// Bounded lock-free queue for many producers and a single consumer.
+//
+// Cells are preallocated, and values are moved in and out of them, so neither
+// push nor pop allocates. Producers claim a cell with a single CAS, and the
+// consumer never contends with them.
+//
+// Based on Dmitry Vyukov's bounded MPMC queue.
+template <typename T>
+class MpscQueue {
+  struct Cell {
+    std::atomic<size_t> seq;
+    T val;
+  };
+
+  std::unique_ptr<Cell[]> cells;
+  size_t mask;
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+
+ public:
+  // Capacity is rounded up to a power of two.
+  explicit MpscQueue(size_t capacity) {
+    size_t cap = 1;
+    while (cap < capacity) {
+      cap <<= 1;
+    }
+    cells.reset(new Cell[cap]);
+    mask = cap - 1;
+    for (size_t i = 0; i < cap; i++) {
+      cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  size_t capacity() const {
+    return mask + 1;
+  }
+
+  // Moves from val and returns true, unless the queue is full.
+  // Safe to call from any thread.
+  bool try_push(T& val) {
+    Cell* cell;
+    size_t pos = head.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells[pos & mask];
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+      if (dif == 0) {
+        if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (dif < 0) {
+        return false;
+      } else {
+        pos = head.load(std::memory_order_relaxed);
+      }
+    }
+    cell->val = std::move(val);
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Moves the oldest value into out and returns true, unless the queue is empty.
+  // Must only be called from the consumer thread.
+  bool try_pop(T& out) {
+    size_t pos = tail.load(std::memory_order_relaxed);
+    Cell* cell = &cells[pos & mask];
+    size_t seq = cell->seq.load(std::memory_order_acquire);
+    if ((intptr_t)seq - (intptr_t)(pos + 1) < 0) {
+      return false;
+    }
+    out = std::move(cell->val);
+    cell->val = T();
+    cell->seq.store(pos + mask + 1, std::memory_order_release);
+    tail.store(pos + 1, std::memory_order_relaxed);
+    return true;
+  }
+};
+
+}  // namespace a0::api
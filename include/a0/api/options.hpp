@@ -21,6 +21,21 @@ const std::unordered_map<std::string, scheduler_t>& scheduler_map() {
   return val;
 }
 
+enum struct backpressure_t {
+  THROTTLE,
+  CONFLATE,
+  SHED,
+};
+
+const std::unordered_map<std::string, backpressure_t>& backpressure_map() {
+  static std::unordered_map<std::string, backpressure_t> val = {
+      {"THROTTLE", backpressure_t::THROTTLE},
+      {"CONFLATE", backpressure_t::CONFLATE},
+      {"SHED", backpressure_t::SHED},
+  };
+  return val;
+}
+
 const std::unordered_map<std::string, Reader::Init>& init_map() {
   static std::unordered_map<std::string, Reader::Init> val = {
       {"OLDEST", INIT_OLDEST},
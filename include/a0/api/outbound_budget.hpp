@@ -0,0 +1,241 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "a0/api/global_state.hpp"
+#include "a0/api/options.hpp"
+
+namespace a0::api {
+
+// Outbound bytes held on behalf of one websocket.
+struct OutboundUsage {
+  uint64_t id{0};
+  std::string target;
+  std::string remote_address;
+  backpressure_t policy{backpressure_t::THROTTLE};
+
+  // Frames serialized, but not yet handed to the socket.
+  // Set far below zero once closed, so late updates skip the global count.
+  std::atomic<int64_t> queued{0};
+  // Frames the socket is holding, waiting for the network.
+  // Only updated within the event loop.
+  std::atomic<int64_t> buffered{0};
+  // Frames dropped in favor of a newer one.
+  std::atomic<uint64_t> conflated{0};
+
+  // CONFLATE only. The newest frame, held back until the socket catches up.
+  std::mutex pending_mu;
+  std::optional<std::string> pending;
+  bool closed{false};
+
+  // SHED only. Closes the socket. Only called within the event loop.
+  std::function<void()> shed;
+
+  int64_t total() const {
+    return std::max<int64_t>(queued, 0) + buffered;
+  }
+};
+
+// Process-wide limit on outbound bytes, across all websockets.
+//
+// Each socket may buffer up to maxBackpressure on its own. With many sockets
+// on a stalled network, that adds up. When the total goes over budget, each
+// socket applies its backpressure policy:
+// * THROTTLE: the A0 thread waits for room before sending.
+// * CONFLATE: only the newest frame is kept until the socket catches up.
+// * SHED: the sockets holding the most bytes are closed first.
+struct OutboundBudget {
+  std::atomic<int64_t> limit{256 << 20};
+  std::atomic<int64_t> used{0};
+  std::atomic<int64_t> peak{0};
+
+  std::atomic<uint64_t> throttled{0};
+  std::atomic<uint64_t> conflated{0};
+  std::atomic<uint64_t> shed{0};
+
+  // Number of A0 threads waiting for room.
+  std::atomic<int64_t> waiters{0};
+  std::atomic<uint64_t> next_id{0};
+
+  // Only used within the event loop.
+  std::set<OutboundUsage*> sockets;
+
+  static OutboundBudget* get() {
+    static OutboundBudget budget;
+    return &budget;
+  }
+
+  // Added to a closed socket's queued bytes.
+  static constexpr int64_t kClosedQueued = INT64_MIN / 2;
+
+  bool over() const {
+    return used >= limit;
+  }
+
+  void add_queued(OutboundUsage& usage, int64_t size) {
+    if (usage.queued.fetch_add(size) >= 0) {
+      add(size);
+    }
+  }
+
+  void sub_queued(OutboundUsage& usage, int64_t size) {
+    if (usage.queued.fetch_sub(size) >= 0) {
+      sub(size);
+    }
+  }
+
+  // Runs on the event loop.
+  void set_buffered(OutboundUsage& usage, int64_t size) {
+    int64_t delta = size - usage.buffered.exchange(size);
+    if (delta > 0) {
+      add(delta);
+    } else if (delta < 0) {
+      sub(-delta);
+    }
+  }
+
+  // Runs on an A0 thread. Blocks until there is room, the socket has nothing
+  // outstanding, or the socket is done.
+  void throttle(OutboundUsage& usage, const std::atomic<bool>& done) {
+    throttled++;
+    waiters++;
+    {
+      std::unique_lock<std::mutex> lk{global()->mu};
+      global()->cv.wait(lk, [&]() {
+        return !global()->running || done || !over() || usage.total() == 0;
+      });
+    }
+    waiters--;
+  }
+
+  // Runs on the event loop.
+  void open(OutboundUsage& usage) {
+    usage.id = next_id++;
+    sockets.insert(&usage);
+  }
+
+  // Runs on the event loop.
+  void close(OutboundUsage& usage) {
+    sockets.erase(&usage);
+    set_buffered(usage, 0);
+    std::optional<std::string> pending;
+    {
+      std::unique_lock<std::mutex> lk{usage.pending_mu};
+      pending.swap(usage.pending);
+      usage.closed = true;
+    }
+    if (pending) {
+      sub_queued(usage, pending->size());
+    }
+    // Frames still on their way to the socket are released as they arrive,
+    // or dropped on the A0 thread. Either way, they no longer count.
+    int64_t queued = usage.queued.exchange(kClosedQueued);
+    if (queued > 0) {
+      sub(queued);
+    }
+  }
+
+  // Runs on the event loop.
+  // Sheds the largest SHED sockets, until the rest fit in the budget.
+  void enforce() {
+    int64_t excess = used - limit;
+    if (excess < 0) {
+      return;
+    }
+
+    std::vector<OutboundUsage*> candidates;
+    for (auto* usage : sockets) {
+      if (usage->policy == backpressure_t::SHED && usage->total() > 0) {
+        candidates.push_back(usage);
+      }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](auto* lhs, auto* rhs) {
+      return lhs->total() > rhs->total();
+    });
+
+    std::vector<OutboundUsage*> victims;
+    for (auto* usage : candidates) {
+      if (excess < 0) {
+        break;
+      }
+      excess -= usage->total();
+      victims.push_back(usage);
+    }
+
+    // Shedding closes the socket, which removes it from the set.
+    for (auto* usage : victims) {
+      sockets.erase(usage);
+    }
+    for (auto* usage : victims) {
+      shed++;
+      usage->shed();
+    }
+  }
+
+  // Runs on the event loop.
+  nlohmann::json stats() const {
+    std::vector<OutboundUsage*> by_usage(sockets.begin(), sockets.end());
+    std::sort(by_usage.begin(), by_usage.end(), [](auto* lhs, auto* rhs) {
+      return lhs->total() > rhs->total();
+    });
+
+    auto sockets_json = nlohmann::json::array();
+    for (auto* usage : by_usage) {
+      std::string policy;
+      for (auto&& [name, val] : backpressure_map()) {
+        if (val == usage->policy) {
+          policy = name;
+        }
+      }
+      sockets_json.push_back({
+          {"id", usage->id},
+          {"target", usage->target},
+          {"remote_address", usage->remote_address},
+          {"policy", policy},
+          {"queued", usage->queued.load()},
+          {"buffered", usage->buffered.load()},
+          {"conflated", usage->conflated.load()},
+      });
+    }
+
+    return {
+        {"budget", limit.load()},
+        {"used", used.load()},
+        {"peak", peak.load()},
+        {"throttled", throttled.load()},
+        {"conflated", conflated.load()},
+        {"shed", shed.load()},
+        {"sockets", sockets_json},
+    };
+  }
+
+ private:
+  void add(int64_t size) {
+    int64_t now = used += size;
+    int64_t prev = peak;
+    while (now > prev && !peak.compare_exchange_weak(prev, now)) {
+    }
+  }
+
+  void sub(int64_t size) {
+    used -= size;
+    if (waiters) {
+      // Locked so a throttled thread can't miss the notification between
+      // checking the budget and going to sleep.
+      { std::unique_lock<std::mutex> lk{global()->mu}; }
+      global()->cv.notify_all();
+    }
+  }
+};
+
+}  // namespace a0::api
@@ -17,7 +17,7 @@ struct RequestMessage {
   std::string path;
   std::string topic;
   Packet pkt;
-  std::function<std::string(std::string_view)> response_encoder;
+  PayloadEncoder response_encoder;
 
   template <typename FieldT>
   void require(const FieldT& field) const {
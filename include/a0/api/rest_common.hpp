@@ -5,6 +5,7 @@
 #include <functional>
 #include <string_view>
 
+#include "a0/api/loop_watchdog.hpp"
 #include "a0/api/request_message.hpp"
 
 namespace a0::api {
@@ -22,11 +23,34 @@ static inline void rest_respond(uWS::HttpResponse<false>* res,
   res->end(body);
 }
 
+// Query parameters in order, decoded. Repeated keys appear once per value.
+static inline std::vector<std::pair<std::string, std::string>> query_params(uWS::HttpRequest* req) {
+  std::vector<std::pair<std::string, std::string>> params;
+  auto query = req->getQuery();
+  if (query.empty()) {
+    return params;
+  }
+  for (auto part : strutil::split(query, "&")) {
+    if (part.empty()) {
+      continue;
+    }
+    auto eq = part.find('=');
+    if (eq == std::string_view::npos) {
+      params.push_back({strutil::url_decode(part), ""});
+    } else {
+      params.push_back({strutil::url_decode(part.substr(0, eq)), strutil::url_decode(part.substr(eq + 1))});
+    }
+  }
+  return params;
+}
+
 static inline void rest_common(
     uWS::HttpResponse<false>* res,
     uWS::HttpRequest* req,
     std::function<void(const RequestMessage&)> impl) {
-  res->onData([res, impl, ss = std::stringstream()](std::string_view chunk, bool is_end) mutable {
+  // The request is handled once the body is in, and timed under the route.
+  res->onData([res, impl = watched_route(std::move(impl)), ss = std::stringstream()](std::string_view chunk,
+                                                                                       bool is_end) mutable {
     ss << chunk;
     if (!is_end) {
       return;
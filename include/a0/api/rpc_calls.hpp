@@ -0,0 +1,38 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <cstdint>
+
+namespace a0::api {
+
+// Counters for rpc calls, across /api/rpc and /wsapi/rpc.
+struct RpcCalls {
+  // Applied when a request has no timeout_ms. 0 for no deadline.
+  std::atomic<uint64_t> default_timeout_ms{30000};
+
+  // Gauge of calls awaiting a response.
+  std::atomic<int64_t> pending{0};
+
+  std::atomic<uint64_t> completed{0};
+  std::atomic<uint64_t> timed_out{0};
+  std::atomic<uint64_t> cancelled{0};
+
+  static RpcCalls* get() {
+    static RpcCalls calls;
+    return &calls;
+  }
+
+  nlohmann::json stats() const {
+    return {
+        {"default_timeout_ms", default_timeout_ms.load()},
+        {"pending", pending.load()},
+        {"completed", completed.load()},
+        {"timed_out", timed_out.load()},
+        {"cancelled", cancelled.load()},
+    };
+  }
+};
+
+}  // namespace a0::api
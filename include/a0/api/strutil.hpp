@@ -44,6 +44,37 @@ struct strutil {
     return parts;
   }
 
+  // Decodes a url query component: "+" is a space, and "%XX" is a byte.
+  // Malformed escapes are kept as is.
+  static std::string url_decode(std::string_view str) {
+    auto hex = [](char c) -> int {
+      if (c >= '0' && c <= '9') {
+        return c - '0';
+      }
+      if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+      }
+      if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+      }
+      return -1;
+    };
+
+    std::string out;
+    out.reserve(str.size());
+    for (size_t i = 0; i < str.size(); i++) {
+      if (str[i] == '+') {
+        out.push_back(' ');
+      } else if (str[i] == '%' && i + 2 < str.size() && hex(str[i + 1]) >= 0 && hex(str[i + 2]) >= 0) {
+        out.push_back((char)(hex(str[i + 1]) * 16 + hex(str[i + 2])));
+        i += 2;
+      } else {
+        out.push_back(str[i]);
+      }
+    }
+    return out;
+  }
+
   static bool endswith(std::string_view str, std::string_view suffix) {
     return str.size() >= suffix.size() &&
            str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
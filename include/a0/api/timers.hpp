@@ -0,0 +1,98 @@
+#pragma once
+
+#include <App.h>
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <utility>
+
+#include "a0/api/global_state.hpp"
+
+namespace a0::api {
+
+// One-shot callbacks, run on the event loop after a delay.
+//
+// All pending callbacks share a single loop timer, armed for the earliest
+// deadline. Only used within the event loop.
+struct Timers {
+  using Clock = std::chrono::steady_clock;
+  using Id = uint64_t;
+
+  static Timers* get() {
+    static Timers timers;
+    return &timers;
+  }
+
+  // Runs fn after ms milliseconds, unless cancelled first.
+  Id after(uint64_t ms, std::function<void()> fn) {
+    Id id = ++next_id;
+    auto deadline = Clock::now() + std::chrono::milliseconds(ms);
+    queue.emplace(std::make_pair(deadline, id), std::move(fn));
+    deadlines[id] = deadline;
+    arm();
+    return id;
+  }
+
+  // No-op if the callback already ran.
+  void cancel(Id id) {
+    auto it = deadlines.find(id);
+    if (it == deadlines.end()) {
+      return;
+    }
+    queue.erase({it->second, id});
+    deadlines.erase(it);
+  }
+
+  size_t size() const {
+    return queue.size();
+  }
+
+ private:
+  Timers() {
+    // Fallthrough: pending callbacks don't keep the event loop alive on shutdown.
+    timer = us_create_timer((us_loop_t*)global()->event_loop, /* fallthrough = */ 1, 0);
+  }
+
+  static void on_timer(us_timer_t*) {
+    get()->fire();
+  }
+
+  void fire() {
+    armed = false;
+    auto now = Clock::now();
+    while (!queue.empty() && queue.begin()->first.first <= now) {
+      auto node = queue.extract(queue.begin());
+      deadlines.erase(node.key().second);
+      // May add or cancel other callbacks.
+      node.mapped()();
+    }
+    arm();
+  }
+
+  void arm() {
+    if (queue.empty()) {
+      return;
+    }
+    auto next = queue.begin()->first.first;
+    if (armed && armed_for <= next) {
+      return;
+    }
+    auto ms = std::chrono::ceil<std::chrono::milliseconds>(next - Clock::now()).count();
+    // A zero delay would disarm the timer.
+    us_timer_set(timer, &Timers::on_timer, std::max<int64_t>(ms, 1), 0);
+    armed = true;
+    armed_for = next;
+  }
+
+  us_timer_t* timer;
+  bool armed{false};
+  Clock::time_point armed_for;
+
+  Id next_id{0};
+  std::map<std::pair<Clock::time_point, Id>, std::function<void()>> queue;
+  std::unordered_map<Id, Clock::time_point> deadlines;
+};
+
+}  // namespace a0::api
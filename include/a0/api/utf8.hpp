@@ -0,0 +1,116 @@
+#pragma once
+
+#include <a0.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace a0::api {
+
+namespace utf8 {
+
+namespace detail {
+
+// Validates one multi-byte sequence starting at data[i], which is known to be non-ascii.
+// Returns the length of the sequence, or 0 if it is invalid.
+A0_STATIC_INLINE
+size_t sequence_length(const uint8_t* data, size_t i, size_t size) {
+  uint8_t lead = data[i];
+  size_t len;
+  uint8_t lo = 0x80;
+  uint8_t hi = 0xBF;
+  if (lead >= 0xC2 && lead <= 0xDF) {
+    len = 2;
+  } else if (lead >= 0xE0 && lead <= 0xEF) {
+    len = 3;
+    // Reject overlong encodings and utf-16 surrogates.
+    if (lead == 0xE0) {
+      lo = 0xA0;
+    } else if (lead == 0xED) {
+      hi = 0x9F;
+    }
+  } else if (lead >= 0xF0 && lead <= 0xF4) {
+    len = 4;
+    // Reject overlong encodings and code points past U+10FFFF.
+    if (lead == 0xF0) {
+      lo = 0x90;
+    } else if (lead == 0xF4) {
+      hi = 0x8F;
+    }
+  } else {
+    return 0;
+  }
+
+  if (size - i < len) {
+    return 0;
+  }
+  if (data[i + 1] < lo || data[i + 1] > hi) {
+    return 0;
+  }
+  for (size_t j = 2; j < len; j++) {
+    if ((data[i + j] & 0xC0) != 0x80) {
+      return 0;
+    }
+  }
+  return len;
+}
+
+// Returns the number of leading ascii bytes in data[i, size), scanning a block at a time.
+A0_STATIC_INLINE
+size_t ascii_run(const uint8_t* data, size_t i, size_t size) {
+  size_t start = i;
+#ifdef __SSE2__
+  while (size - i >= 16) {
+    __m128i block = _mm_loadu_si128((const __m128i*)(data + i));
+    int mask = _mm_movemask_epi8(block);
+    if (mask) {
+      return i - start + __builtin_ctz(mask);
+    }
+    i += 16;
+  }
+#endif
+  while (size - i >= 8) {
+    uint64_t word;
+    memcpy(&word, data + i, 8);
+    if (word & 0x8080808080808080ull) {
+      break;
+    }
+    i += 8;
+  }
+  while (i < size && data[i] < 0x80) {
+    i++;
+  }
+  return i - start;
+}
+
+}  // namespace detail
+
+// Whether the input is well-formed utf-8.
+// Ascii runs, the common case for text payloads, are checked a block at a time.
+A0_STATIC_INLINE
+bool valid(std::string_view input) {
+  auto* data = (const uint8_t*)input.data();
+  size_t size = input.size();
+  size_t i = 0;
+  while (i < size) {
+    i += detail::ascii_run(data, i, size);
+    if (i == size) {
+      break;
+    }
+    size_t len = detail::sequence_length(data, i, size);
+    if (!len) {
+      return false;
+    }
+    i += len;
+  }
+  return true;
+}
+
+}  // namespace utf8
+
+}  // namespace a0::api
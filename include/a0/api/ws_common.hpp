@@ -1,20 +1,49 @@
 #pragma once
 
+#include "a0/api/buffer_pool.hpp"
+#include "a0/api/delta.hpp"
+#include "a0/api/header_filter.hpp"
+#include "a0/api/outbound_budget.hpp"
+#include "a0/api/ws_outbox.hpp"
+
 namespace a0::api {
 
 // Accessed from all threads.
 struct WSCommon : std::enable_shared_from_this<WSCommon> {
+  // Set when the websocket opens. Stale once it closes.
+  WSHandle handle;
+
   scheduler_t sched{scheduler_t::ON_DRAIN};
 
   uint64_t reader_seq_min{0};
   Reader::Init reader_init{Reader::Init::AWAIT_NEW};
   Reader::Iter reader_iter{Reader::Iter::NEXT};
+  // Optional. Packets whose headers don't match are dropped on the A0 thread.
+  std::shared_ptr<const HeaderFilter> filter;
+
+  // Pre-serialized members added to every response envelope, each followed by a comma.
+  std::string envelope_fields;
+
+  // Optional. Payloads are sent as changes to the previous one.
+  std::shared_ptr<DeltaEncoder> delta;
 
   std::atomic<int64_t> wake_cnt{0};
+  // Counts the times the socket wrote out everything queued, whatever the scheduler.
+  std::atomic<int64_t> drain_cnt{0};
   std::function<void()> wake_hook;
   bool init{false};
   std::atomic<bool> done{false};
 
+  // Optional. Run on the event loop in place of writing to, or ending, the websocket.
+  // Used when several streams share one websocket.
+  std::function<void(std::string)> deliver_hook;
+  std::function<void(int, std::string)> end_hook;
+
+  // Frames are serialized into buffers from here, and returned once sent.
+  BufferPool pool;
+  // This socket's share of the outbound budget.
+  OutboundUsage outbound;
+
   template <typename WebSocket>
   void OnMessageWithHandshake(
       WebSocket* ws,
@@ -36,7 +65,7 @@ struct WSCommon : std::enable_shared_from_this<WSCommon> {
         return;
       }
 
-      init = true;
+      start(ws);
       return;
     }
 
@@ -46,6 +75,12 @@ struct WSCommon : std::enable_shared_from_this<WSCommon> {
       return;
     }
 
+    // If the handshake is complete, and delta is on, and message is "FULL", send the next payload whole.
+    if (delta && msg == std::string_view("FULL")) {
+      delta->full_requested = true;
+      return;
+    }
+
     // Error. Should not init multiple times!
     ws->end(4000, "Handshake only allowed once per websocket.");
   }
@@ -53,6 +88,8 @@ struct WSCommon : std::enable_shared_from_this<WSCommon> {
   void LoadCommonOptions(const RequestMessage& req_msg) {
     req_msg.maybe_option_to("scheduler", scheduler_map(), sched),
         req_msg.maybe_option_to("iter", iter_map(), reader_iter);
+    req_msg.maybe_option_to("backpressure", backpressure_map(), outbound.policy);
+    outbound.target = req_msg.topic.empty() ? req_msg.path : req_msg.topic;
 
     // Get the optional 'init' option.
     // It may be an int representing the earliest acceptable sequence number.
@@ -69,6 +106,35 @@ struct WSCommon : std::enable_shared_from_this<WSCommon> {
         req_msg.maybe_option_to("init", init_map(), reader_init);
       }
     }
+
+    // Get the optional 'delta' option.
+    bool delta_requested = false;
+    req_msg.maybe_get_to("delta", delta_requested);
+    if (delta_requested) {
+      // A conflated frame would be dropped, and the next change would not apply.
+      if (outbound.policy == backpressure_t::CONFLATE) {
+        throw std::invalid_argument("Option delta can't be combined with CONFLATE backpressure.");
+      }
+      delta = std::make_shared<DeltaEncoder>();
+      req_msg.maybe_get_to("response_encoding", delta->encoding);
+      req_msg.maybe_get_to("delta_full_every", delta->full_every);
+    }
+
+    // Get the optional 'filter' option.
+    auto filter_field = req_msg.raw_msg.find("filter");
+    if (filter_field != req_msg.raw_msg.end() && !filter_field->is_null()) {
+      filter = std::make_shared<HeaderFilter>(HeaderFilter::Parse(*filter_field));
+    }
+  }
+
+  // The encoder to write payloads with. Applies delta, if requested.
+  PayloadEncoder payload_encoder(PayloadEncoder encoder) const {
+    if (!delta) {
+      return encoder;
+    }
+    return [delta = delta, encoder = std::move(encoder)](std::string_view payload, std::string& out) {
+      delta->write_payload(payload, encoder, out);
+    };
   }
 
   void wake() {
@@ -94,35 +160,179 @@ struct WSCommon : std::enable_shared_from_this<WSCommon> {
     });
   }
 
+  // Blocks until the socket writes out everything queued before pre_drain_cnt was read.
+  // Used between the fragments of a chunked packet, whatever the scheduler.
+  void wait_drain(int64_t pre_drain_cnt) {
+    std::unique_lock<std::mutex> lk{global()->mu};
+    global()->cv.wait(lk, [this, pre_drain_cnt]() {
+      return !global()->running || done || pre_drain_cnt < drain_cnt;
+    });
+  }
+
+  // Runs on the event loop, once the socket has written out everything queued.
+  void drained() {
+    drain_cnt++;
+    if (sched == scheduler_t::ON_DRAIN) {
+      wake();
+    } else {
+      global()->cv.notify_all();
+    }
+  }
+
+  // Marks the handshake complete, and starts accounting outbound bytes.
+  template <typename WebSocket>
+  void start(WebSocket* ws) {
+    outbound.remote_address = std::string(ws->getRemoteAddressAsText());
+    outbound.shed = [this]() {
+      if (auto* ws = socket<WebSocket>()) {
+        ws->end(1013, "Outbound budget exceeded.");
+      }
+    };
+    OutboundBudget::get()->open(outbound);
+    init = true;
+  }
+
+  template <typename WebSocket>
+  static void onopen(WebSocket* ws) {
+    auto* data = ws->getUserData();
+    data->ws_common = std::make_shared<WSCommon>();
+    data->ws_common->handle = global()->active_ws.insert(ws);
+  }
+
+  // Runs on the event loop.
+  // Returns nullptr once the websocket has closed.
+  template <typename WebSocket>
+  WebSocket* socket() const {
+    return (WebSocket*)global()->active_ws.get(handle);
+  }
+
   template <typename WebSocket>
   void ondrain(WebSocket* ws) {
-    if (sched == scheduler_t::ON_DRAIN && ws->getBufferedAmount() == 0) {
-      wake();
+    OutboundBudget::get()->set_buffered(outbound, ws->getBufferedAmount());
+    maybe_send_pending<WebSocket>();
+    if (ws->getBufferedAmount() == 0) {
+      drained();
     }
   }
 
   template <typename WebSocket>
   void onclose(WebSocket* ws) {
+    global()->active_ws.erase(handle);
+    finish();
+  }
+
+  // Stops sending, and unblocks the A0 thread.
+  void finish() {
     done = true;
-    global()->active_ws.erase(ws);
+    if (init) {
+      OutboundBudget::get()->close(outbound);
+    }
     global()->cv.notify_all();
   }
 
+  // The frame is delivered through the handle. The ws argument only selects the socket type.
   template <typename WebSocket>
-  void send(WebSocket* ws, std::string str) {
+  void send(WebSocket*, std::string str) {
+    auto* budget = OutboundBudget::get();
+    if (budget->over()) {
+      if (outbound.policy == backpressure_t::THROTTLE &&
+          std::this_thread::get_id() != global()->event_loop_thread) {
+        budget->throttle(outbound, done);
+      } else if (outbound.policy == backpressure_t::CONFLATE && outbound.total() > 0) {
+        conflate(std::move(str));
+        return;
+      }
+    }
+
+    budget->add_queued(outbound, str.size());
+
     // Schedule the event loop to perform the send operation.
-    global()->event_loop->defer(
-        [self = shared_from_this(), ws, str = std::move(str)]() {
-          // Make sure the ws hasn't closed between the reader callback and this task.
-          if (!global()->running || !global()->active_ws.count(ws)) {
-            return;
-          }
-          auto send_status = ws->send(std::move(str), uWS::TEXT, true);
+    WSTask task{shared_from_this(), &WSCommon::run_send<WebSocket>, 0, std::move(str)};
+    if (!WSOutbox::get()->push(task, done)) {
+      budget->sub_queued(outbound, task.str.size());
+      pool.release(std::move(task.str));
+    }
+  }
+
+  // Holds the frame back in place of any older one, until the socket catches up.
+  void conflate(std::string str) {
+    auto* budget = OutboundBudget::get();
+
+    std::optional<std::string> dropped;
+    {
+      std::unique_lock<std::mutex> lk{outbound.pending_mu};
+      if (outbound.closed) {
+        pool.release(std::move(str));
+        return;
+      }
+      budget->add_queued(outbound, str.size());
+      dropped.swap(outbound.pending);
+      outbound.pending = std::move(str);
+    }
+
+    if (dropped) {
+      outbound.conflated++;
+      budget->conflated++;
+      budget->sub_queued(outbound, dropped->size());
+      pool.release(std::move(*dropped));
+    }
+  }
+
+  // Runs on the event loop.
+  template <typename WebSocket>
+  void maybe_send_pending() {
+    auto* ws = socket<WebSocket>();
+    if (!ws || (OutboundBudget::get()->over() && ws->getBufferedAmount() > 0)) {
+      return;
+    }
+
+    std::optional<std::string> pending;
+    {
+      std::unique_lock<std::mutex> lk{outbound.pending_mu};
+      pending.swap(outbound.pending);
+    }
+    if (pending) {
+      send_now<WebSocket>(std::move(*pending));
+    }
+  }
 
-          if (self->sched == scheduler_t::ON_DRAIN && send_status == ws->SUCCESS) {
-            self->wake();
-          }
-        });
+  // Runs on the event loop.
+  template <typename WebSocket>
+  void send_now(std::string str) {
+    auto* budget = OutboundBudget::get();
+
+    // Make sure the ws hasn't closed between the reader callback and this task.
+    auto* ws = socket<WebSocket>();
+    if (!global()->running || !ws) {
+      budget->sub_queued(outbound, str.size());
+      pool.release(std::move(str));
+      return;
+    }
+
+    if (deliver_hook) {
+      // The frame stays queued until the hook writes it out.
+      deliver_hook(std::move(str));
+      return;
+    }
+
+    budget->sub_queued(outbound, str.size());
+    auto send_status = ws->send(str, uWS::TEXT, true);
+    // The socket has copied or written out the frame.
+    pool.release(std::move(str));
+
+    budget->set_buffered(outbound, ws->getBufferedAmount());
+    budget->enforce();
+
+    if (send_status == ws->SUCCESS) {
+      drained();
+    }
+  }
+
+  // Runs on the event loop.
+  template <typename WebSocket>
+  static void run_send(WSTask& task) {
+    task.self->send_now<WebSocket>(std::move(task.str));
+    task.self->maybe_send_pending<WebSocket>();
   }
 
   template <typename WebSocket>
@@ -133,17 +343,26 @@ struct WSCommon : std::enable_shared_from_this<WSCommon> {
   }
 
   template <typename WebSocket>
-  void end(WebSocket* ws, int code, std::string str) {
+  void end(WebSocket*, int code, std::string str) {
     // Schedule the event loop to perform the end operation.
-    global()->event_loop->defer(
-        [self = shared_from_this(), ws, code, str = std::move(str)]() {
-          // Make sure the ws hasn't closed between the reader callback and this task.
-          if (!global()->running || !global()->active_ws.count(ws)) {
-            return;
-          }
-          ws->end(code, std::move(str));
-          self->wake();
-        });
+    WSTask task{shared_from_this(), &WSCommon::run_end<WebSocket>, code, std::move(str)};
+    WSOutbox::get()->push(task, done);
+  }
+
+  // Runs on the event loop.
+  template <typename WebSocket>
+  static void run_end(WSTask& task) {
+    // Make sure the ws hasn't closed between the reader callback and this task.
+    auto* ws = task.self->socket<WebSocket>();
+    if (!global()->running || !ws) {
+      return;
+    }
+    if (task.self->end_hook) {
+      task.self->end_hook(task.code, std::move(task.str));
+      return;
+    }
+    ws->end(task.code, std::move(task.str));
+    task.self->wake();
   }
 
   template <typename WebSocket>
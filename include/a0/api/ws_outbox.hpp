@@ -0,0 +1,121 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "a0/api/global_state.hpp"
+#include "a0/api/loop_watchdog.hpp"
+#include "a0/api/mpsc_queue.hpp"
+
+namespace a0::api {
+
+struct WSCommon;
+
+// A websocket operation handed from an A0 thread to the event loop.
+struct WSTask {
+  std::shared_ptr<WSCommon> self;
+  // Performs the operation. Instantiated per websocket type.
+  void (*run)(WSTask&){nullptr};
+  int code{0};
+  std::string str;
+};
+
+// Hands websocket operations from A0 threads to the event loop.
+//
+// Producers push into a preallocated lock-free queue, without allocating.
+// The event loop is woken once per burst, rather than once per message,
+// and drains everything queued on each wakeup.
+struct WSOutbox {
+  static constexpr size_t kCapacity = 8192;
+
+  MpscQueue<WSTask> queue{kCapacity};
+  std::atomic<bool> drain_scheduled{false};
+
+  std::atomic<uint64_t> pushed{0};
+  std::atomic<uint64_t> popped{0};
+  std::atomic<uint64_t> drains{0};
+  std::atomic<uint64_t> last_batch{0};
+  std::atomic<uint64_t> max_batch{0};
+  std::atomic<uint64_t> full{0};
+
+  static WSOutbox* get() {
+    static WSOutbox outbox;
+    return &outbox;
+  }
+
+  // Safe to call from any thread.
+  // If the queue is full, the task is dropped once its websocket is done.
+  // Returns false if dropped, leaving the task with the caller to clean up.
+  bool push(WSTask& task, const std::atomic<bool>& done) {
+    while (!queue.try_push(task)) {
+      full++;
+      if (std::this_thread::get_id() == global()->event_loop_thread) {
+        // The event loop can't wait on itself. Make room.
+        drain();
+        continue;
+      }
+      // The event loop may be tearing down this websocket, waiting on this thread.
+      if (!global()->running || done) {
+        return false;
+      }
+      // Wait for the event loop to catch up. This backpressures the A0 thread.
+      schedule_drain();
+      std::this_thread::yield();
+    }
+    pushed++;
+    schedule_drain();
+    return true;
+  }
+
+  // Runs on the event loop.
+  void drain() {
+    // Cleared before popping: anything pushed after this point either gets
+    // popped below, or schedules another drain.
+    drain_scheduled = false;
+
+    uint64_t batch = 0;
+    WSTask task;
+    while (queue.try_pop(task)) {
+      task.run(task);
+      task = WSTask();
+      batch++;
+    }
+
+    popped += batch;
+    drains++;
+    last_batch = batch;
+    if (batch > max_batch) {
+      max_batch = batch;
+    }
+  }
+
+  nlohmann::json stats() const {
+    uint64_t num_pushed = pushed;
+    uint64_t num_popped = popped;
+    uint64_t num_drains = drains;
+    return {
+        {"capacity", queue.capacity()},
+        {"depth", num_pushed - std::min(num_pushed, num_popped)},
+        {"pushed", num_pushed},
+        {"drains", num_drains},
+        {"full", full.load()},
+        {"last_batch", last_batch.load()},
+        {"max_batch", max_batch.load()},
+        {"mean_batch", num_drains ? double(num_popped) / num_drains : 0.0},
+    };
+  }
+
+ private:
+  void schedule_drain() {
+    if (!drain_scheduled.exchange(true)) {
+      defer("ws_outbox", []() { WSOutbox::get()->drain(); });
+    }
+  }
+};
+
+}  // namespace a0::api
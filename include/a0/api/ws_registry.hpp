@@ -0,0 +1,98 @@
+#pragma once
+
+#include <App.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace a0::api {
+
+// Identifies a registered websocket.
+//
+// Handles go stale when their socket closes. A stale handle never resolves to
+// a socket, even after its slot, or the socket's address, is reused.
+struct WSHandle {
+  uint32_t slot{0};
+  // Live generations are odd, so a default handle is never valid.
+  uint32_t gen{0};
+};
+
+// Slot map of open websockets.
+// Lookups by handle are O(1). Only used within the event loop.
+struct WSRegistry {
+  using Socket = uWS::AsyncSocket<false>;
+
+  WSHandle insert(Socket* ws) {
+    uint32_t slot;
+    if (free_slots.empty()) {
+      slot = slots.size();
+      slots.emplace_back();
+    } else {
+      slot = free_slots.back();
+      free_slots.pop_back();
+    }
+    auto& entry = slots[slot];
+    entry.gen++;
+    entry.ws = ws;
+    num_active++;
+    num_opened++;
+    return {slot, entry.gen};
+  }
+
+  void erase(WSHandle handle) {
+    if (!get(handle)) {
+      return;
+    }
+    auto& entry = slots[handle.slot];
+    entry.gen++;
+    entry.ws = nullptr;
+    free_slots.push_back(handle.slot);
+    num_active--;
+  }
+
+  // Returns nullptr if the handle is stale.
+  Socket* get(WSHandle handle) const {
+    if (handle.slot >= slots.size()) {
+      return nullptr;
+    }
+    auto& entry = slots[handle.slot];
+    return entry.gen == handle.gen ? entry.ws : nullptr;
+  }
+
+  // Calls fn(handle, ws) for each open websocket.
+  // fn may close the websocket it is given.
+  template <typename Fn>
+  void for_each(Fn&& fn) const {
+    for (uint32_t slot = 0; slot < slots.size(); slot++) {
+      auto& entry = slots[slot];
+      if (entry.ws) {
+        fn(WSHandle{slot, entry.gen}, entry.ws);
+      }
+    }
+  }
+
+  size_t size() const {
+    return num_active;
+  }
+
+  size_t capacity() const {
+    return slots.size();
+  }
+
+  uint64_t opened() const {
+    return num_opened;
+  }
+
+ private:
+  struct Entry {
+    uint32_t gen{0};
+    Socket* ws{nullptr};
+  };
+
+  std::vector<Entry> slots;
+  std::vector<uint32_t> free_slots;
+  size_t num_active{0};
+  uint64_t num_opened{0};
+};
+
+}  // namespace a0::api
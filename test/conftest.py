@@ -48,10 +48,23 @@ class RunApi:
 
 
 @pytest.fixture()
-def api_proc():
+def api_proc(monkeypatch):
     tmp_dir = tempfile.TemporaryDirectory(prefix="/dev/shm/")
-    os.environ["A0_ROOT"] = tmp_dir.name
-    os.environ["PORT_STR"] = str(random.randint(49152, 65535))
+    monkeypatch.setenv("A0_ROOT", tmp_dir.name)
+    monkeypatch.setenv("PORT_STR", str(random.randint(49152, 65535)))
+    api = RunApi()
+    api.start()
+    yield api
+    api.shutdown()
+
+
+@pytest.fixture()
+def api_proc_unix(monkeypatch):
+    tmp_dir = tempfile.TemporaryDirectory(prefix="/dev/shm/")
+    monkeypatch.setenv("A0_ROOT", tmp_dir.name)
+    # Only listen on the unix domain socket.
+    monkeypatch.setenv("PORT_STR", "")
+    monkeypatch.setenv("API_UNIX_SOCKET", os.path.join(tmp_dir.name, "api.sock"))
     api = RunApi()
     api.start()
     yield api
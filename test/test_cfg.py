@@ -0,0 +1,118 @@
+import a0
+import asyncio
+import json
+import requests
+import websockets
+
+
+def test_get(api_proc):
+    a0.Cfg("mycfg").write(json.dumps({"a": {"b": [1, 2]}, "c": "d"}))
+
+    resp = requests.get(api_proc.addr("api", "cfg"), params={"topic": "mycfg"})
+    assert resp.status_code == 200
+    assert resp.json() == {"a": {"b": [1, 2]}, "c": "d"}
+
+    resp = requests.get(api_proc.addr("api", "cfg"),
+                        params={
+                            "topic": "mycfg",
+                            "path": "/a/b/1"
+                        })
+    assert resp.status_code == 200
+    assert resp.json() == 2
+
+    resp = requests.get(api_proc.addr("api", "cfg"),
+                        params={
+                            "topic": "mycfg",
+                            "path": "/x"
+                        })
+    assert resp.status_code == 404
+    assert resp.text == "Cfg has no value at path: /x"
+
+    resp = requests.get(api_proc.addr("api", "cfg"))
+    assert resp.status_code == 400
+    assert resp.text == "Request missing required field: topic"
+
+
+def test_get_unwritten(api_proc):
+    resp = requests.get(api_proc.addr("api", "cfg"),
+                        params={"topic": "unwritten"},
+                        timeout=1.0)
+    assert resp.status_code == 404
+    assert resp.text == "Cfg has not been written."
+
+    # The event loop wasn't held up.
+    resp = requests.get(api_proc.addr("api", "ls"), timeout=1.0)
+    assert resp.status_code == 200
+
+    a0.Cfg("unwritten").write(json.dumps({"a": 1}))
+    resp = requests.get(api_proc.addr("api", "cfg"),
+                        params={"topic": "unwritten"})
+    assert resp.status_code == 200
+    assert resp.json() == {"a": 1}
+
+
+def test_mergepatch(api_proc):
+    a0.Cfg("mycfg").write(json.dumps({"a": 1, "b": {"c": 2, "d": 3}}))
+
+    resp = requests.post(api_proc.addr("api", "cfg"),
+                         data=json.dumps({
+                             "topic": "mycfg",
+                             "patch": {
+                                 "b": {
+                                     "c": 4,
+                                     "d": None
+                                 },
+                                 "e": 5
+                             },
+                         }))
+    assert resp.status_code == 200
+    assert resp.text == "success"
+
+    assert json.loads(a0.Cfg("mycfg").read().payload) == {
+        "a": 1,
+        "b": {
+            "c": 4
+        },
+        "e": 5,
+    }
+
+    resp = requests.post(api_proc.addr("api", "cfg"),
+                         data=json.dumps({"topic": "mycfg"}))
+    assert resp.status_code == 400
+    assert resp.text == "Request missing required field: patch"
+
+
+async def test_watch(api_proc):
+    cfg = a0.Cfg("mycfg")
+    cfg.write(json.dumps({"a": {"b": 1}, "c": 2}))
+
+    async with websockets.connect(api_proc.addr("wsapi", "cfg")) as ws:
+        await ws.send(json.dumps({"topic": "mycfg", "path": "/a"}))
+
+        msg = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+        assert msg == {"value": {"b": 1}}
+
+        # Outside the watched path.
+        cfg.write(json.dumps({"a": {"b": 1}, "c": 3}))
+        # Inside.
+        cfg.write(json.dumps({"a": {"b": 2}, "c": 3}))
+
+        msg = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+        assert msg == {"patch": [{"op": "replace", "path": "/b", "value": 2}]}
+
+
+async def test_watch_conflate(api_proc):
+    caught = False
+    try:
+        async with websockets.connect(api_proc.addr("wsapi", "cfg")) as ws:
+            await ws.send(
+                json.dumps({
+                    "topic": "mycfg",
+                    "backpressure": "CONFLATE",
+                }))
+            await asyncio.wait_for(ws.recv(), timeout=1.0)
+    except websockets.ConnectionClosedError as e:
+        caught = True
+        assert e.code == 4000
+        assert e.reason == "Option backpressure CONFLATE isn't supported for cfg."
+    assert caught
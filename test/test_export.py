@@ -0,0 +1,132 @@
+import a0
+import gzip
+import json
+import os
+import requests
+import struct
+
+
+def raw_records(body):
+    records = []
+    i = 0
+    while i < len(body):
+        (size,) = struct.unpack_from("<Q", body, i)
+        records.append(body[i + 8:i + 8 + size])
+        i += 8 + size
+    assert i == len(body)
+    return records
+
+
+def test_raw(api_proc):
+    w = a0.Writer(a0.File("myfile"))
+    for i in range(3):
+        w.write(f"payload {i}")
+
+    resp = requests.get(api_proc.addr("api", "export"),
+                        params={"path": "myfile"})
+    assert resp.status_code == 200
+    assert resp.headers["Content-Type"] == "application/octet-stream"
+    records = raw_records(resp.content)
+    assert len(records) == 3
+    for i, record in enumerate(records):
+        assert record.endswith(f"payload {i}".encode())
+
+
+def test_ndjson(api_proc):
+    w = a0.Writer(a0.File("myfile"))
+    w.write("payload 0")
+    w.write(b"\xff\xfe")
+    w.write('{"a": 1}')
+
+    resp = requests.get(api_proc.addr("api", "export"),
+                        params={
+                            "path": "myfile",
+                            "format": "ndjson",
+                        })
+    assert resp.status_code == 200
+    lines = [json.loads(line) for line in resp.text.splitlines()]
+    assert [line["seq"] for line in lines] == [
+        lines[0]["seq"] + i for i in range(3)
+    ]
+    assert lines[0]["payload"] == "payload 0"
+    assert lines[1]["encoding"] == "base64"
+    assert lines[2]["payload"] == {"a": 1}
+
+
+def test_range_gzip(api_proc):
+    w = a0.Writer(a0.File("myfile"))
+    for i in range(10):
+        w.write(f"payload {i}")
+
+    resp = requests.get(api_proc.addr("api", "export"),
+                        params={
+                            "path": "myfile",
+                            "format": "ndjson",
+                        })
+    seqs = [json.loads(line)["seq"] for line in resp.text.splitlines()]
+
+    resp = requests.get(api_proc.addr("api", "export"),
+                        params={
+                            "path": "myfile",
+                            "format": "ndjson",
+                            "gzip": "1",
+                            "seq_min": str(seqs[2]),
+                            "seq_max": str(seqs[4]),
+                        },
+                        stream=True)
+    assert resp.status_code == 200
+    assert resp.headers["Content-Encoding"] == "gzip"
+    body = gzip.decompress(resp.raw.read(decode_content=False)).decode()
+    lines = [json.loads(line) for line in body.splitlines()]
+    assert [line["payload"] for line in lines
+           ] == ["payload 2", "payload 3", "payload 4"]
+
+
+def test_large(api_proc):
+    # Spans several batches.
+    w = a0.Writer(a0.File("myfile"))
+    payload = "x" * 1024 * 1024
+    for i in range(10):
+        w.write(payload)
+
+    resp = requests.get(api_proc.addr("api", "export"),
+                        params={"path": "myfile"})
+    records = raw_records(resp.content)
+    assert len(records) == 10
+    assert all(record.endswith(payload.encode()) for record in records)
+
+
+def test_empty(api_proc):
+    a0.File("myfile")
+
+    resp = requests.get(api_proc.addr("api", "export"),
+                        params={
+                            "path": "myfile",
+                            "format": "ndjson",
+                        })
+    assert resp.status_code == 200
+    assert resp.text == ""
+
+    resp = requests.get(api_proc.addr("api", "export"),
+                        params={
+                            "path": "myfile",
+                            "gzip": "1",
+                        })
+    assert resp.status_code == 200
+    assert resp.content == b""
+
+
+def test_nonexistent(api_proc):
+    resp = requests.get(api_proc.addr("api", "export"),
+                        params={"path": "nofile"})
+    assert resp.status_code == 404
+    assert resp.text == "File does not exist: nofile"
+
+    # Not created by the request.
+    assert not os.path.exists(os.path.join(os.environ["A0_ROOT"], "nofile"))
+
+
+def test_missing_path(api_proc):
+    resp = requests.get(api_proc.addr("api", "export"))
+    assert resp.status_code == 400
+    assert resp.text == "Request missing required field: path"
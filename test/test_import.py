@@ -0,0 +1,115 @@
+import a0
+import gzip
+import json
+import requests
+
+
+def export_ndjson(api_proc, path):
+    resp = requests.get(api_proc.addr("api", "export"),
+                        params={
+                            "path": path,
+                            "format": "ndjson",
+                        })
+    assert resp.status_code == 200
+    return [json.loads(line) for line in resp.text.splitlines()]
+
+
+def test_raw_roundtrip(api_proc):
+    w = a0.Writer(a0.File("src"))
+    w.write(a0.Packet([("key", "val")], "payload 0"))
+    w.write(b"\xff\xfe")
+
+    resp = requests.get(api_proc.addr("api", "export"), params={"path": "src"})
+    resp = requests.post(api_proc.addr("api", "import"),
+                         params={"path": "dst"},
+                         data=resp.content)
+    assert resp.status_code == 200
+    assert resp.json() == {"written": 2}
+
+    src = export_ndjson(api_proc, "src")
+    dst = export_ndjson(api_proc, "dst")
+    assert [(p["headers"], p["payload"]) for p in dst
+           ] == [(p["headers"], p["payload"]) for p in src]
+
+
+def test_ndjson_gzip(api_proc):
+    body = "\n".join([
+        json.dumps({
+            "headers": [["a0_time_wall", "2021-01-01T00:00:00.000000000-00:00"]],
+            "payload": "payload 0",
+        }),
+        json.dumps({
+            "payload": "cGF5bG9hZCAx",
+            "encoding": "base64",
+        }),
+        json.dumps({"payload": {
+            "a": 1
+        }}),
+    ])
+
+    resp = requests.post(api_proc.addr("api", "import"),
+                         params={
+                             "path": "dst",
+                             "format": "ndjson",
+                             "standard_headers": "1",
+                         },
+                         headers={"Content-Encoding": "gzip"},
+                         data=gzip.compress(body.encode()))
+    assert resp.status_code == 200
+    assert resp.json() == {"written": 3}
+
+    dst = export_ndjson(api_proc, "dst")
+    assert [p["payload"] for p in dst] == ["payload 0", "payload 1", {"a": 1}]
+    hdrs = [dict(p["headers"]) for p in dst]
+    assert hdrs[0]["a0_time_wall"] == "2021-01-01T00:00:00.000000000-00:00"
+    assert all("a0_transport_seq" in h and "a0_time_mono" in h for h in hdrs)
+
+
+def test_ndjson_roundtrip(api_proc):
+    payloads = [
+        b'{"b": 1, "a": [1.10, 1e2]}',
+        b'"hi"',
+        b"plain text",
+        b"\xff\xfe",
+    ]
+    w = a0.Writer(a0.File("src"))
+    for payload in payloads:
+        w.write(payload)
+
+    resp = requests.get(api_proc.addr("api", "export"),
+                        params={
+                            "path": "src",
+                            "format": "ndjson",
+                        })
+    resp = requests.post(api_proc.addr("api", "import"),
+                         params={
+                             "path": "dst",
+                             "format": "ndjson",
+                         },
+                         data=resp.content)
+    assert resp.status_code == 200
+    assert resp.json() == {"written": 4}
+
+    reader = a0.ReaderSync(a0.File("dst"), a0.INIT_OLDEST)
+    got = []
+    while reader.can_read():
+        got.append(reader.read().payload)
+    assert got == payloads
+
+
+def test_invalid_record(api_proc):
+    body = json.dumps({"payload": "payload 0"}) + "\nnot json\n"
+    resp = requests.post(api_proc.addr("api", "import"),
+                         params={
+                             "path": "dst",
+                             "format": "ndjson",
+                         },
+                         data=body)
+    assert resp.status_code == 400
+    assert resp.text == "Invalid record 2: must be a json object  written: 1"
+
+    resp = requests.post(api_proc.addr("api", "import"),
+                         params={"path": "dst"},
+                         data=b"\x05\x00\x00\x00\x00\x00\x00\x00abc")
+    assert resp.status_code == 400
+    assert resp.text == "Invalid record 1: truncated  written: 0"
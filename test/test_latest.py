@@ -0,0 +1,93 @@
+from .b64 import atob
+import a0
+import requests
+import threading
+import time
+
+
+def test_latest(api_proc):
+    p = a0.Publisher("mytopic")
+    p.pub("payload 0")
+    p.pub("payload 1")
+
+    resp = requests.get(api_proc.addr("api", "latest"), params={"topic": "mytopic"})
+    assert resp.status_code == 200
+    assert resp.json()["payload"] == "payload 1"
+    etag = resp.headers["ETag"]
+
+    resp = requests.get(api_proc.addr("api", "latest"),
+                        params={"topic": "mytopic"},
+                        headers={"If-None-Match": etag})
+    assert resp.status_code == 304
+    assert resp.headers["ETag"] == etag
+
+    p.pub("payload 2")
+    time.sleep(0.1)
+    resp = requests.get(api_proc.addr("api", "latest"),
+                        params={"topic": "mytopic"},
+                        headers={"If-None-Match": etag})
+    assert resp.status_code == 200
+    assert resp.json()["payload"] == "payload 2"
+    assert resp.headers["ETag"] != etag
+
+
+def test_multi(api_proc):
+    a0.Publisher("topic_a").pub("payload a")
+    a0.Publisher("topic_b").pub("payload b")
+
+    resp = requests.get(api_proc.addr("api", "latest"),
+                        params=[("topic", "topic_a"), ("topic", "topic_b"),
+                                ("topic", "topic_c"),
+                                ("response_encoding", "base64")])
+    assert resp.status_code == 200
+    body = resp.json()
+    assert atob(body["topic_a"]["payload"]) == "payload a"
+    assert atob(body["topic_b"]["payload"]) == "payload b"
+    assert body["topic_c"] is None
+
+
+def test_wait(api_proc):
+    p = a0.Publisher("mytopic")
+    p.pub("payload 0")
+
+    resp = requests.get(api_proc.addr("api", "latest"), params={"topic": "mytopic"})
+    etag = resp.headers["ETag"]
+
+    # Nothing changes.
+    start = time.time()
+    resp = requests.get(api_proc.addr("api", "latest"),
+                        params={"topic": "mytopic", "wait_ms": 200},
+                        headers={"If-None-Match": etag})
+    assert resp.status_code == 304
+    assert time.time() - start >= 0.2
+
+    # Woken by the next packet.
+    threading.Timer(0.2, lambda: p.pub("payload 1")).start()
+    resp = requests.get(api_proc.addr("api", "latest"),
+                        params={"topic": "mytopic", "wait_ms": 5000},
+                        headers={"If-None-Match": etag})
+    assert resp.status_code == 200
+    assert resp.json()["payload"] == "payload 1"
+
+    stats = requests.get(api_proc.addr("api", "stats")).json()["latest"]
+    assert stats["topics"] == 1
+    assert stats["waiters"] == 0
+
+
+def test_errors(api_proc):
+    resp = requests.get(api_proc.addr("api", "latest"))
+    assert resp.status_code == 400
+    assert resp.text == "Request missing required field: topic"
+
+    resp = requests.get(api_proc.addr("api", "latest"), params={"topic": "/"})
+    assert resp.status_code == 400
+    assert resp.text == "Invalid topic name"
+
+    resp = requests.get(api_proc.addr("api", "latest"),
+                        params={"topic": "mytopic", "wait_ms": "soon"})
+    assert resp.status_code == 400
+    assert resp.text.startswith("Request field has incorrect format. field: wait_ms")
+
+    resp = requests.get(api_proc.addr("api", "latest"), params={"topic": "empty"})
+    assert resp.status_code == 404
+    assert resp.text == "Topic has no packets."
@@ -0,0 +1,136 @@
+import a0
+import asyncio
+import json
+import requests
+import websockets
+
+
+def test_search(api_proc):
+    logger = a0.Logger("mytopic")
+    logger.info("connected to lidar")
+    logger.err("Timeout waiting for lidar")
+    logger.dbg("timeout debug detail")
+    logger.info("all good")
+
+    resp = requests.post(api_proc.addr("api", "log/search"),
+                         data=json.dumps({
+                             "topic": "mytopic",
+                             "query": {
+                                 "text": "timeout",
+                                 "ignore_case": True,
+                             },
+                         }))
+    assert resp.status_code == 200
+    result = resp.json()
+    assert result["complete"]
+    assert result["scanned"] == 4
+    assert [m["payload"] for m in result["matches"]
+           ] == ["Timeout waiting for lidar"]
+
+    resp = requests.post(api_proc.addr("api", "log/search"),
+                         data=json.dumps({
+                             "topic": "mytopic",
+                             "level": "DBG",
+                             "query": {
+                                 "text": "TIMEOUT",
+                                 "ignore_case": True,
+                             },
+                         }))
+    assert [m["payload"] for m in resp.json()["matches"]] == [
+        "Timeout waiting for lidar",
+        "timeout debug detail",
+    ]
+
+    resp = requests.post(api_proc.addr("api", "log/search"),
+                         data=json.dumps({
+                             "topic": "mytopic",
+                             "query": {
+                                 "text": "lidar",
+                                 "limit": 1,
+                             },
+                         }))
+    assert [m["payload"] for m in resp.json()["matches"]
+           ] == ["connected to lidar"]
+
+
+def test_search_limit(api_proc):
+    logger = a0.Logger("mytopic")
+    for i in range(1005):
+        logger.info(f"line {i}")
+
+    resp = requests.post(api_proc.addr("api", "log/search"),
+                         data=json.dumps({
+                             "topic": "mytopic",
+                             "query": {
+                                 "text": "line",
+                             },
+                         }))
+    assert len(resp.json()["matches"]) == 1000
+
+    resp = requests.post(api_proc.addr("api", "log/search"),
+                         data=json.dumps({
+                             "topic": "mytopic",
+                             "query": {
+                                 "text": "line",
+                                 "limit": 0,
+                             },
+                         }))
+    result = resp.json()
+    assert result["complete"]
+    assert len(result["matches"]) == 1005
+
+
+def test_search_empty(api_proc):
+    resp = requests.post(api_proc.addr("api", "log/search"),
+                         data=json.dumps({"topic": "mytopic"}))
+    assert resp.status_code == 200
+    assert resp.json() == {"matches": [], "scanned": 0, "complete": True}
+
+
+def test_search_bad_query(api_proc):
+    resp = requests.post(api_proc.addr("api", "log/search"),
+                         data=json.dumps({
+                             "topic": "mytopic",
+                             "query": {
+                                 "regex": "(a+)+b",
+                             },
+                         }))
+    assert resp.status_code == 400
+    assert resp.text == "Invalid query: regex isn't supported. Use text."
+
+
+async def test_query(api_proc):
+    logger = a0.Logger("mytopic")
+    logger.info("request 1 ok")
+    logger.info("request 2 failed")
+    logger.info("request 3 ok")
+    logger.info("request 4 failed")
+    logger.info("request 5 failed")
+
+    async with websockets.connect(api_proc.addr("wsapi", "log")) as ws:
+        await ws.send(
+            json.dumps({
+                "topic": "mytopic",
+                "init": "OLDEST",
+                "query": {
+                    "text": "failed",
+                    "limit": 2,
+                },
+            }))
+
+        try:
+            pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+            assert pkt["payload"] == "request 2 failed"
+            pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+            assert pkt["payload"] == "request 4 failed"
+        except asyncio.TimeoutError:
+            assert False
+
+        closed = False
+        try:
+            await asyncio.wait_for(ws.recv(), timeout=1.0)
+        except websockets.ConnectionClosedOK as e:
+            closed = True
+            assert e.code == 1000
+            assert e.reason == "Query limit reached."
+        assert closed
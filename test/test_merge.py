@@ -0,0 +1,160 @@
+import a0
+import asyncio
+import json
+import pytest
+import time
+import websockets
+
+
+async def test_ordered(api_proc):
+    pa = a0.Publisher("topic_a")
+    pb = a0.Publisher("topic_b")
+    # Published in the order they should be merged, with a0_time_mono standard headers.
+    pa.pub("a 0")
+    pb.pub("b 0")
+    pa.pub("a 1")
+    pb.pub("b 1")
+
+    async with websockets.connect(api_proc.addr("wsapi", "merge")) as ws:
+        await ws.send(
+            json.dumps({
+                "topics": ["topic_a", "topic_b"],
+                "init": "OLDEST",
+                "scheduler": "IMMEDIATE",
+            }))
+
+        try:
+            got = [
+                json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+                for _ in range(4)
+            ]
+        except asyncio.TimeoutError:
+            assert False
+        assert [(p["topic"], p["payload"]) for p in got] == [
+            ("topic_a", "a 0"),
+            ("topic_b", "b 0"),
+            ("topic_a", "a 1"),
+            ("topic_b", "b 1"),
+        ]
+
+
+async def test_ordered_history(api_proc):
+    pa = a0.Publisher("topic_a")
+    pb = a0.Publisher("topic_b")
+    for i in range(5):
+        pa.pub(f"a {i}")
+        pb.pub(f"b {i}")
+    # History older than the window is still merged.
+    time.sleep(0.6)
+
+    async with websockets.connect(api_proc.addr("wsapi", "merge")) as ws:
+        await ws.send(
+            json.dumps({
+                "topics": ["topic_a", "topic_b"],
+                "window_ms": 500,
+                "init": "OLDEST",
+                "scheduler": "IMMEDIATE",
+            }))
+
+        try:
+            got = [
+                json.loads(await asyncio.wait_for(ws.recv(), timeout=2.0))
+                for _ in range(10)
+            ]
+        except asyncio.TimeoutError:
+            assert False
+        want = []
+        for i in range(5):
+            want += [("topic_a", f"a {i}"), ("topic_b", f"b {i}")]
+        assert [(p["topic"], p["payload"]) for p in got] == want
+
+
+@pytest.fixture()
+def small_outbound_budget(monkeypatch):
+    # Requested before api_proc, so the api starts with it.
+    monkeypatch.setenv("OUTBOUND_BUDGET_MB", "1")
+
+
+async def test_ordered_throttled(small_outbound_budget, api_proc):
+    pa = a0.Publisher("topic_a")
+    pb = a0.Publisher("topic_b")
+    payload = "x" * (64 << 10)
+    for i in range(40):
+        pa.pub(f"a {i} {payload}")
+        pb.pub(f"b {i} {payload}")
+
+    async with websockets.connect(api_proc.addr("wsapi", "merge"),
+                                  max_size=None) as ws:
+        await ws.send(
+            json.dumps({
+                "topics": ["topic_a", "topic_b"],
+                "init": "OLDEST",
+                "scheduler": "IMMEDIATE",
+            }))
+
+        # Let the A0 threads fill the budget, and throttle, while the tick timer runs.
+        await asyncio.sleep(0.5)
+
+        try:
+            got = [
+                json.loads(await asyncio.wait_for(ws.recv(), timeout=3.0))
+                for _ in range(80)
+            ]
+        except asyncio.TimeoutError:
+            assert False
+        for topic in ["topic_a", "topic_b"]:
+            assert [
+                int(p["payload"].split(" ")[1])
+                for p in got
+                if p["topic"] == topic
+            ] == list(range(40))
+
+
+async def test_sync(api_proc):
+    pa = a0.Publisher("topic_a")
+    pb = a0.Publisher("topic_b")
+    pa.pub("a 0")
+    time.sleep(0.1)
+    pa.pub("a 1")
+    pb.pub("b 0")
+    time.sleep(0.1)
+    pa.pub("a 2")
+    pb.pub("b 1")
+
+    async with websockets.connect(api_proc.addr("wsapi", "merge")) as ws:
+        await ws.send(
+            json.dumps({
+                "topics": ["topic_a", "topic_b"],
+                "mode": "sync",
+                "tolerance_ms": 20,
+                "init": "OLDEST",
+                "scheduler": "IMMEDIATE",
+            }))
+
+        try:
+            got = [
+                json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+                for _ in range(2)
+            ]
+        except asyncio.TimeoutError:
+            assert False
+        assert [(t["topics"]["topic_a"]["payload"],
+                 t["topics"]["topic_b"]["payload"]) for t in got] == [
+                     ("a 1", "b 0"),
+                     ("a 2", "b 1"),
+                 ]
+        assert all(t["skew_ms"] <= 20 for t in got)
+
+
+async def test_bad_mode(api_proc):
+    async with websockets.connect(api_proc.addr("wsapi", "merge")) as ws:
+        await ws.send(json.dumps({"topics": ["topic_a"], "mode": "zip"}))
+
+        caught = False
+        try:
+            await ws.recv()
+        except websockets.ConnectionClosedError as e:
+            caught = True
+            assert e.code == 4000
+            assert e.reason == "Request has unknown value for field: mode  value: zip"
+        assert caught
@@ -0,0 +1,202 @@
+import a0
+import asyncio
+import json
+import websockets
+
+
+async def recv_all(ws, n):
+    pkts = []
+    try:
+        for _ in range(n):
+            pkts.append(json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0)))
+    except asyncio.TimeoutError:
+        assert False
+    return pkts
+
+
+async def test_channels(api_proc):
+    a0.Publisher("topic_a").pub("payload a")
+    a0.Publisher("topic_b").pub("payload b")
+    a0.Writer(a0.File("myread")).write("payload c")
+
+    async with websockets.connect(api_proc.addr("wsapi", "mux")) as ws:
+        await ws.send(
+            json.dumps({
+                "cmd": "subscribe",
+                "channel": 1,
+                "topic": "topic_a",
+                "init": "OLDEST",
+            }))
+        await ws.send(
+            json.dumps({
+                "cmd": "subscribe",
+                "channel": 2,
+                "topic": "topic_b",
+                "init": "OLDEST",
+            }))
+        await ws.send(
+            json.dumps({
+                "cmd": "read",
+                "channel": 3,
+                "path": "myread",
+                "init": "OLDEST",
+            }))
+
+        pkts = await recv_all(ws, 3)
+        assert {pkt["channel"]: pkt["payload"] for pkt in pkts} == {
+            1: "payload a",
+            2: "payload b",
+            3: "payload c",
+        }
+
+
+async def test_unsubscribe(api_proc):
+    p = a0.Publisher("mytopic")
+
+    async with websockets.connect(api_proc.addr("wsapi", "mux")) as ws:
+        await ws.send(
+            json.dumps({
+                "cmd": "subscribe",
+                "channel": 7,
+                "topic": "mytopic",
+            }))
+        await asyncio.sleep(0.1)
+
+        p.pub("payload 0")
+        pkts = await recv_all(ws, 1)
+        assert pkts[0]["channel"] == 7
+        assert pkts[0]["payload"] == "payload 0"
+
+        await ws.send(json.dumps({"cmd": "unsubscribe", "channel": 7}))
+        await asyncio.sleep(0.1)
+
+        p.pub("payload 1")
+        timed_out = False
+        try:
+            await asyncio.wait_for(ws.recv(), timeout=1.0)
+        except asyncio.TimeoutError:
+            timed_out = True
+        assert timed_out
+
+
+async def test_fair(api_proc):
+    busy = a0.Publisher("busy")
+    for i in range(100):
+        busy.pub(f"busy {i}")
+    a0.Publisher("quiet").pub("quiet 0")
+
+    async with websockets.connect(api_proc.addr("wsapi", "mux")) as ws:
+        await ws.send(
+            json.dumps({
+                "cmd": "subscribe",
+                "channel": 1,
+                "topic": "busy",
+                "init": "OLDEST",
+                "scheduler": "IMMEDIATE",
+            }))
+        await ws.send(
+            json.dumps({
+                "cmd": "subscribe",
+                "channel": 2,
+                "topic": "quiet",
+                "init": "OLDEST",
+                "scheduler": "IMMEDIATE",
+            }))
+
+        pkts = await recv_all(ws, 101)
+        busy_pkts = [pkt["payload"] for pkt in pkts if pkt["channel"] == 1]
+        quiet_pkts = [pkt["payload"] for pkt in pkts if pkt["channel"] == 2]
+        assert busy_pkts == [f"busy {i}" for i in range(100)]
+        assert quiet_pkts == ["quiet 0"]
+
+
+async def test_ack(api_proc):
+    p = a0.Publisher("mytopic")
+    p.pub("payload 0")
+    p.pub("payload 1")
+
+    async with websockets.connect(api_proc.addr("wsapi", "mux")) as ws:
+        await ws.send(
+            json.dumps({
+                "cmd": "subscribe",
+                "channel": 1,
+                "topic": "mytopic",
+                "init": "OLDEST",
+                "scheduler": "ON_ACK",
+            }))
+
+        pkts = await recv_all(ws, 1)
+        assert pkts[0]["payload"] == "payload 0"
+
+        timed_out = False
+        try:
+            await asyncio.wait_for(ws.recv(), timeout=1.0)
+        except asyncio.TimeoutError:
+            timed_out = True
+        assert timed_out
+
+        await ws.send(json.dumps({"cmd": "ack", "channel": 1}))
+        pkts = await recv_all(ws, 1)
+        assert pkts[0]["payload"] == "payload 1"
+
+
+async def test_errors(api_proc):
+    async with websockets.connect(api_proc.addr("wsapi", "mux")) as ws:
+        await ws.send(json.dumps({"cmd": "subscribe", "channel": 1}))
+        assert json.loads(await ws.recv()) == {
+            "channel": 1,
+            "error": "Request missing required field: topic",
+        }
+
+        await ws.send(json.dumps({"cmd": "foo", "channel": 2}))
+        assert json.loads(await ws.recv()) == {
+            "channel": 2,
+            "error": "Request has unknown value for field: cmd  value: foo",
+        }
+
+        await ws.send("not json")
+        assert json.loads(await ws.recv()) == {
+            "channel": None,
+            "error": "Request must be json.",
+        }
+
+        await ws.send(json.dumps({"cmd": "subscribe", "channel": 3, "topic": "mytopic"}))
+        await ws.send(json.dumps({"cmd": "subscribe", "channel": 3, "topic": "mytopic"}))
+        assert json.loads(await ws.recv()) == {
+            "channel": 3,
+            "error": "Channel already open.",
+        }
+
+
+async def test_channel_error(api_proc):
+    p = a0.Publisher("mytopic")
+    p.pub(b"y8\xa1\xb1:\xca,\x11\xe0,\xf8\xd5\xe4\xb9u\x89")
+    p.pub("payload 1")
+
+    async with websockets.connect(api_proc.addr("wsapi", "mux")) as ws:
+        await ws.send(
+            json.dumps({
+                "cmd": "subscribe",
+                "channel": 1,
+                "topic": "mytopic",
+                "init": "OLDEST",
+            }))
+        assert json.loads(await ws.recv()) == {
+            "channel": 1,
+            "error": "[json.exception.type_error.316] invalid UTF-8 byte at index 2: 0xA1",
+        }
+
+        # The socket stays open for other channels.
+        await ws.send(
+            json.dumps({
+                "cmd": "subscribe",
+                "channel": 2,
+                "topic": "mytopic",
+                "init": "MOST_RECENT",
+            }))
+        pkts = await recv_all(ws, 1)
+        assert pkts[0] == {
+            "channel": 2,
+            "headers": pkts[0]["headers"],
+            "payload": "payload 1",
+        }
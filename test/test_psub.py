@@ -0,0 +1,127 @@
+import a0
+import asyncio
+import json
+import websockets
+
+
+async def test_psub(api_proc):
+    a0.Publisher("robot/arm/left").pub("left 0")
+    a0.Publisher("robot/arm/right").pub("right 0")
+    a0.Publisher("robot/leg").pub("leg 0")
+
+    async with websockets.connect(api_proc.addr("wsapi", "psub")) as ws:
+        await ws.send(json.dumps({
+            "topic": "robot/arm/*",
+            "init": "OLDEST",
+        }))
+
+        try:
+            pkts = [
+                json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+                for _ in range(2)
+            ]
+            assert sorted((pkt["topic"], pkt["payload"]) for pkt in pkts) == [
+                ("robot/arm/left", "left 0"),
+                ("robot/arm/right", "right 0"),
+            ]
+        except asyncio.TimeoutError:
+            assert False
+
+        # A topic created after the handshake.
+        await asyncio.sleep(0.5)
+        p = a0.Publisher("robot/arm/wrist")
+        p.pub("wrist 0")
+        p.pub("wrist 1")
+
+        try:
+            for i in range(2):
+                pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+                assert pkt["topic"] == "robot/arm/wrist"
+                assert pkt["payload"] == f"wrist {i}"
+        except asyncio.TimeoutError:
+            assert False
+
+        timed_out = False
+        try:
+            await asyncio.wait_for(ws.recv(), timeout=1.0)
+        except asyncio.TimeoutError:
+            timed_out = True
+        assert timed_out
+
+
+async def test_psub_new_topic_early(api_proc):
+    left = a0.Publisher("robot/arm/left")
+    left.pub("left 0")
+
+    async with websockets.connect(api_proc.addr("wsapi", "psub")) as ws:
+        await ws.send(json.dumps({
+            "topic": "robot/arm/*",
+            "init": "AWAIT_NEW",
+        }))
+
+        # Once a live packet arrives, the handshake is done.
+        while True:
+            left.pub("left 1")
+            try:
+                pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=0.1))
+                assert pkt["topic"] == "robot/arm/left"
+                break
+            except asyncio.TimeoutError:
+                pass
+
+        # Created right after. Still read from its first packet.
+        p = a0.Publisher("robot/arm/wrist")
+        p.pub("wrist 0")
+        p.pub("wrist 1")
+
+        wrist = []
+        try:
+            while len(wrist) < 2:
+                pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+                if pkt["topic"] == "robot/arm/wrist":
+                    wrist.append(pkt["payload"])
+        except asyncio.TimeoutError:
+            assert False
+        assert wrist == ["wrist 0", "wrist 1"]
+
+
+async def test_conflate(api_proc):
+    async with websockets.connect(api_proc.addr("wsapi", "psub")) as ws:
+        await ws.send(
+            json.dumps({
+                "topic": "robot/arm/*",
+                "backpressure": "CONFLATE",
+            }))
+
+        caught = False
+        try:
+            await ws.recv()
+        except websockets.ConnectionClosedError as e:
+            caught = True
+            assert e.code == 4000
+            assert e.reason == "Option backpressure CONFLATE isn't supported for psub."
+        assert caught
+
+
+async def test_catchup(api_proc):
+    p = a0.Publisher("robot/arm/left")
+    for i in range(3):
+        p.pub(f"left {i}")
+
+    async with websockets.connect(api_proc.addr("wsapi", "psub")) as ws:
+        await ws.send(
+            json.dumps({
+                "topic": "robot/arm/*",
+                "init": "OLDEST",
+                "catchup": True,
+            }))
+
+        try:
+            msg = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+        except asyncio.TimeoutError:
+            assert False
+        # The topic is carried once, by the batch.
+        assert msg["topic"] == "robot/arm/left"
+        assert msg["live"]
+        assert [pkt["payload"] for pkt in msg["batch"]] == [f"left {i}" for i in range(3)]
+        assert all("topic" not in pkt for pkt in msg["batch"])
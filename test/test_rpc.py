@@ -3,6 +3,7 @@ import a0
 import json
 import pytest
 import requests
+import time
 import types
 
 
@@ -92,3 +93,72 @@ def test_b64_resp_encoding(api_proc, rpc_server):
     resp = requests.post(api_proc.addr("api", "rpc"), data=json.dumps(jpkt))
     assert resp.status_code == 200
     assert atob(resp.json()["payload"]) == "success"
+
+
+def test_json_resp_encoding(api_proc):
+
+    def on_request(req):
+        req.reply(json.dumps({"ok": True}))
+
+    server = a0.RpcServer("jsontopic", on_request, None)
+
+    jpkt = SIMPLE_REQUEST_JPKT()
+    jpkt["topic"] = "jsontopic"
+    jpkt["response_encoding"] = "json"
+    resp = requests.post(api_proc.addr("api", "rpc"), data=json.dumps(jpkt))
+    assert resp.status_code == 200
+    assert resp.json()["payload"] == {"ok": True}
+
+
+def test_timeout(api_proc):
+    ns = types.SimpleNamespace()
+    ns.held_requests = []
+    ns.cancel_ids = []
+
+    def on_request(req):
+        ns.held_requests.append(req)
+
+    def on_cancel(id_):
+        ns.cancel_ids.append(id_)
+
+    server = a0.RpcServer("slowtopic", on_request, on_cancel)
+
+    jpkt = SIMPLE_REQUEST_JPKT()
+    jpkt["topic"] = "slowtopic"
+    jpkt["timeout_ms"] = 100
+    resp = requests.post(api_proc.addr("api", "rpc"), data=json.dumps(jpkt))
+    assert resp.status_code == 504
+    assert resp.text == "Deadline exceeded."
+    assert len(ns.held_requests) == 1
+    assert len(ns.cancel_ids) == 1
+
+    stats = requests.get(api_proc.addr("api", "stats")).json()["rpc"]
+    assert stats["pending"] == 0
+    assert stats["timed_out"] == 1
+
+
+def test_abort(api_proc):
+    ns = types.SimpleNamespace()
+    ns.cancel_ids = []
+
+    def on_cancel(id_):
+        ns.cancel_ids.append(id_)
+
+    server = a0.RpcServer("slowtopic", lambda req: None, on_cancel)
+
+    jpkt = SIMPLE_REQUEST_JPKT()
+    jpkt["topic"] = "slowtopic"
+    caught = False
+    try:
+        requests.post(api_proc.addr("api", "rpc"),
+                      data=json.dumps(jpkt),
+                      timeout=0.2)
+    except requests.exceptions.Timeout:
+        caught = True
+    assert caught
+
+    time.sleep(0.1)
+    assert len(ns.cancel_ids) == 1
+    stats = requests.get(api_proc.addr("api", "stats")).json()["rpc"]
+    assert stats["pending"] == 0
+    assert stats["cancelled"] == 1
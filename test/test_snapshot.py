@@ -0,0 +1,72 @@
+from .b64 import atob
+import a0
+import json
+import requests
+
+
+def test_snapshot(api_proc):
+    a0.Publisher("topic_a").pub("payload a")
+    p = a0.Publisher("topic_b")
+    p.pub("payload b0")
+    p.pub("payload b1")
+    a0.Writer(a0.File("myfile")).write("payload c")
+
+    resp = requests.post(api_proc.addr("api", "snapshot"),
+                         data=json.dumps({
+                             "topics": ["topic_a", "topic_b", "topic_empty"],
+                             "paths": ["myfile"],
+                         }))
+    assert resp.status_code == 200
+    body = resp.json()
+    assert body["topics"]["topic_a"]["payload"] == "payload a"
+    assert body["topics"]["topic_b"]["payload"] == "payload b1"
+    assert body["topics"]["topic_b"]["seq"] == 2
+    assert "time_mono" in body["topics"]["topic_b"]
+    assert "time_wall" in body["topics"]["topic_b"]
+    assert body["topics"]["topic_empty"] is None
+    assert body["paths"]["myfile"]["payload"] == "payload c"
+    assert body["skew_ms"] >= 0
+
+
+def test_encoding(api_proc):
+    a0.Publisher("mytopic").pub("payload")
+
+    resp = requests.post(api_proc.addr("api", "snapshot"),
+                         data=json.dumps({
+                             "topics": ["mytopic"],
+                             "response_encoding": "base64",
+                         }))
+    assert resp.status_code == 200
+    assert atob(resp.json()["topics"]["mytopic"]["payload"]) == "payload"
+    assert "paths" not in resp.json()
+
+
+def test_max_skew(api_proc):
+    a0.Publisher("topic_a").pub("payload a")
+    a0.Publisher("topic_b").pub("payload b")
+
+    resp = requests.post(api_proc.addr("api", "snapshot"),
+                         data=json.dumps({
+                             "topics": ["topic_a", "topic_b"],
+                             "max_skew_ms": 0,
+                         }))
+    assert resp.status_code == 409
+    assert resp.text.startswith("Snapshot skew exceeds max_skew_ms.")
+
+    resp = requests.post(api_proc.addr("api", "snapshot"),
+                         data=json.dumps({
+                             "topics": ["topic_a", "topic_b"],
+                             "max_skew_ms": 60000,
+                         }))
+    assert resp.status_code == 200
+
+
+def test_errors(api_proc):
+    resp = requests.post(api_proc.addr("api", "snapshot"), data=json.dumps({}))
+    assert resp.status_code == 400
+    assert resp.text == "Request missing required field: topics"
+
+    resp = requests.post(api_proc.addr("api", "snapshot"),
+                         data=json.dumps({"topics": ["/"]}))
+    assert resp.status_code == 400
+    assert resp.text == "Invalid topic name"
@@ -0,0 +1,121 @@
+import a0
+import asyncio
+import json
+import requests
+import websockets
+
+
+async def test_send_queue(api_proc):
+    p = a0.Publisher("mytopic")
+    for i in range(10):
+        p.pub(f"payload {i}")
+
+    async with websockets.connect(api_proc.addr("wsapi", "sub")) as ws:
+        await ws.send(
+            json.dumps({
+                "topic": "mytopic",
+                "init": "OLDEST",
+                "scheduler": "IMMEDIATE",
+            }))
+
+        try:
+            for i in range(10):
+                pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+                assert pkt["payload"] == f"payload {i}"
+        except asyncio.TimeoutError:
+            assert False
+
+    resp = requests.get(api_proc.addr("api", "stats"))
+    assert resp.status_code == 200
+    assert resp.headers["Access-Control-Allow-Origin"] == "*"
+
+    send_queue = resp.json()["send_queue"]
+    assert send_queue["pushed"] >= 10
+    assert send_queue["depth"] == 0
+    assert send_queue["drains"] >= 1
+    assert 1 <= send_queue["max_batch"] <= 10
+
+    buffer_pool = resp.json()["buffer_pool"]
+    assert buffer_pool["hits"] + buffer_pool["misses"] >= 10
+    assert buffer_pool["hits"] >= 1
+    assert buffer_pool["max_bytes_held"] == 64 << 20
+    assert buffer_pool["bytes_held"] <= buffer_pool["max_bytes_held"]
+
+
+async def test_outbound(api_proc):
+    p = a0.Publisher("mytopic")
+    p.pub("payload")
+
+    async with websockets.connect(api_proc.addr("wsapi", "sub")) as ws:
+        await ws.send(
+            json.dumps({
+                "topic": "mytopic",
+                "init": "OLDEST",
+                "backpressure": "CONFLATE",
+            }))
+
+        try:
+            pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+            assert pkt["payload"] == "payload"
+        except asyncio.TimeoutError:
+            assert False
+
+        resp = requests.get(api_proc.addr("api", "stats"))
+        assert resp.status_code == 200
+
+        outbound = resp.json()["outbound"]
+        assert outbound["budget"] == 256 * 1024 * 1024
+        assert outbound["peak"] > 0
+        assert outbound["shed"] == 0
+        assert len(outbound["sockets"]) == 1
+        assert outbound["sockets"][0]["target"] == "mytopic"
+        assert outbound["sockets"][0]["policy"] == "CONFLATE"
+        assert outbound["sockets"][0]["queued"] == 0
+
+    resp = requests.get(api_proc.addr("api", "stats"))
+    assert resp.json()["outbound"]["sockets"] == []
+    assert resp.json()["outbound"]["used"] == 0
+
+
+async def test_invalid_backpressure(api_proc):
+    async with websockets.connect(api_proc.addr("wsapi", "sub")) as ws:
+        await ws.send(json.dumps({
+            "topic": "mytopic",
+            "backpressure": "FOO",
+        }))
+        caught = False
+        try:
+            await asyncio.wait_for(ws.recv(), timeout=1.0)
+        except websockets.ConnectionClosedError as e:
+            assert e.code == 4000
+            assert e.reason == "Request has unknown value for field: backpressure  value: FOO"
+            caught = True
+        assert caught
+
+
+async def test_connections(api_proc):
+    for _ in range(3):
+        async with websockets.connect(api_proc.addr("wsapi", "sub")) as ws:
+            await ws.send(json.dumps({"topic": "mytopic"}))
+
+            resp = requests.get(api_proc.addr("api", "stats"))
+            assert resp.json()["connections"]["active"] == 1
+
+    resp = requests.get(api_proc.addr("api", "stats"))
+    connections = resp.json()["connections"]
+    assert connections["active"] == 0
+    assert connections["opened"] == 3
+    # Slots are reused.
+    assert connections["slots"] == 1
+
+
+def test_loop(api_proc):
+    requests.get(api_proc.addr("api", "ls"))
+
+    resp = requests.get(api_proc.addr("api", "stats"))
+    loop = resp.json()["loop"]
+    assert loop["threshold_ms"] == 50
+    assert loop["deferred"]["depth"] >= 0
+    assert loop["handlers"]["GET /api/ls"]["count"] == 1
+    assert sum(loop["handlers"]["GET /api/ls"]["buckets"]) == 1
+    assert len(loop["lag"]["le_ms"]) == len(loop["lag"]["buckets"])
@@ -1,6 +1,7 @@
 from .b64 import atob
 import a0
 import asyncio
+import base64
 import json
 import websockets
 
@@ -162,3 +163,390 @@ async def test_init_1_newest(api_proc):
             assert dict(pkt["headers"])["a0_transport_seq"] == "2"
         except asyncio.TimeoutError:
             assert False
+
+
+async def test_filter(api_proc):
+    p = a0.Publisher("mytopic")
+    p.pub(a0.Packet([("source", "lidar_front")], "payload 0"))
+    p.pub(a0.Packet([("source", "camera_left")], "payload 1"))
+    p.pub(a0.Packet([("source", "lidar_rear")], "payload 2"))
+    p.pub(a0.Packet([("source", "lidar_rear"), ("stale", "1")], "payload 3"))
+
+    async with websockets.connect(api_proc.addr("wsapi", "sub")) as ws:
+        await ws.send(
+            json.dumps({
+                "topic": "mytopic",
+                "init": "OLDEST",
+                "filter": {
+                    "and": [
+                        {
+                            "key": "source",
+                            "prefix": "lidar_"
+                        },
+                        {
+                            "key": "stale",
+                            "exists": False
+                        },
+                    ]
+                },
+            }))
+
+        try:
+            pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+            assert pkt["payload"] == "payload 0"
+            pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+            assert pkt["payload"] == "payload 2"
+        except asyncio.TimeoutError:
+            assert False
+
+        timed_out = False
+        try:
+            await asyncio.wait_for(ws.recv(), timeout=1.0)
+        except asyncio.TimeoutError:
+            timed_out = True
+        assert timed_out
+
+
+async def test_invalid_filter(api_proc):
+    caught = False
+    try:
+        async with websockets.connect(api_proc.addr("wsapi", "sub")) as ws:
+            await ws.send(
+                json.dumps({
+                    "topic": "mytopic",
+                    "filter": {
+                        "key": "source"
+                    },
+                }))
+            await asyncio.wait_for(ws.recv(), timeout=1.0)
+    except websockets.ConnectionClosedError as e:
+        caught = True
+        assert e.code == 4000
+        assert e.reason == "Invalid filter: clause requires one of 'eq', 'prefix', 'exists'."
+    assert caught
+
+
+async def test_json_encoding(api_proc):
+    p = a0.Publisher("mytopic")
+    p.pub(json.dumps({"a": [1, "two"]}))
+    p.pub("not json")
+
+    async with websockets.connect(api_proc.addr("wsapi", "sub")) as ws:
+        await ws.send(
+            json.dumps({
+                "topic": "mytopic",
+                "init": "OLDEST",
+                "response_encoding": "json",
+            }))
+
+        try:
+            pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+            assert pkt["payload"] == {"a": [1, "two"]}
+            assert "encoding" not in pkt
+            pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+            assert pkt["payload"] == "not json"
+        except asyncio.TimeoutError:
+            assert False
+
+
+async def test_auto_encoding(api_proc):
+    p = a0.Publisher("mytopic")
+    p.pub(json.dumps({"a": [1, "two"]}))
+    p.pub("not json")
+
+    async with websockets.connect(api_proc.addr("wsapi", "sub")) as ws:
+        await ws.send(
+            json.dumps({
+                "topic": "mytopic",
+                "init": "OLDEST",
+                "response_encoding": "auto",
+            }))
+
+        try:
+            pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+            assert pkt["payload"] == {"a": [1, "two"]}
+            assert pkt["encoding"] == "json"
+            pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+            assert pkt["payload"] == "not json"
+            assert pkt["encoding"] == "none"
+        except asyncio.TimeoutError:
+            assert False
+
+
+async def test_nonutf8_auto_encoding(api_proc):
+    p = a0.Publisher("mytopic")
+    p.pub(b"y8\xa1\xb1:\xca,\x11\xe0,\xf8\xd5\xe4\xb9u\x89")
+    p.pub("plain text")
+
+    async with websockets.connect(api_proc.addr("wsapi", "sub")) as ws:
+        await ws.send(
+            json.dumps({
+                "topic": "mytopic",
+                "init": "OLDEST",
+                "response_encoding": "auto",
+            }))
+
+        try:
+            pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+            assert pkt["encoding"] == "base64"
+            assert base64.b64decode(
+                pkt["payload"]) == b"y8\xa1\xb1:\xca,\x11\xe0,\xf8\xd5\xe4\xb9u\x89"
+            pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+            assert pkt["encoding"] == "none"
+            assert pkt["payload"] == "plain text"
+        except asyncio.TimeoutError:
+            assert False
+
+
+def apply_delta(prev, pkt):
+    if "payload" in pkt:
+        return pkt["payload"]
+    prev = prev.encode()
+    out = b""
+    pos = 0
+    for offset, remove, insert in pkt["delta"]:
+        out += prev[pos:offset] + insert.encode()
+        pos = offset + remove
+    return (out + prev[pos:]).decode()
+
+
+async def test_delta(api_proc):
+    p = a0.Publisher("mytopic")
+    state = "é" + "x" * 1000
+    p.pub(state)
+
+    async with websockets.connect(api_proc.addr("wsapi", "sub")) as ws:
+        await ws.send(
+            json.dumps({
+                "topic": "mytopic",
+                "init": "OLDEST",
+                "delta": True,
+                "delta_full_every": 3,
+            }))
+
+        pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+        assert pkt["payload"] == state
+        current = pkt["payload"]
+
+        for i, edit in enumerate(["y", "€", "zz"]):
+            state = state[:500] + edit + state[500 + len(edit):]
+            p.pub(state)
+            pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+            if i == 2:
+                # Every third message is whole.
+                assert "payload" in pkt
+            else:
+                assert "delta" in pkt
+                assert len(pkt["delta"]) == 1
+            current = apply_delta(current, pkt)
+            assert current == state
+
+        await ws.send("FULL")
+        await asyncio.sleep(0.1)
+        p.pub(state + "!")
+        pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+        assert pkt["payload"] == state + "!"
+
+
+async def test_delta_shrink(api_proc):
+    p = a0.Publisher("mytopic")
+    state = "é" * 300 + "x" * 1000
+    p.pub(state)
+
+    async with websockets.connect(api_proc.addr("wsapi", "sub")) as ws:
+        await ws.send(
+            json.dumps({
+                "topic": "mytopic",
+                "init": "OLDEST",
+                "delta": True,
+            }))
+
+        pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+        current = pkt["payload"]
+
+        # Shrinks to a prefix of the previous payload.
+        state = state[:600]
+        p.pub(state)
+        pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+        assert "delta" in pkt
+        current = apply_delta(current, pkt)
+        assert current == state
+
+
+async def test_delta_json(api_proc):
+    p = a0.Publisher("mytopic")
+    p.pub(json.dumps({"pose": [0, 0], "table": list(range(100))}))
+    p.pub(json.dumps({"pose": [1, 0], "table": list(range(100))}))
+
+    async with websockets.connect(api_proc.addr("wsapi", "sub")) as ws:
+        await ws.send(
+            json.dumps({
+                "topic": "mytopic",
+                "init": "OLDEST",
+                "response_encoding": "json",
+                "delta": True,
+            }))
+
+        pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+        assert pkt["payload"]["pose"] == [0, 0]
+
+        pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+        assert pkt["patch"] == [{"op": "replace", "path": "/pose/0", "value": 1}]
+
+
+async def test_delta_conflate(api_proc):
+    caught = False
+    try:
+        async with websockets.connect(api_proc.addr("wsapi", "sub")) as ws:
+            await ws.send(
+                json.dumps({
+                    "topic": "mytopic",
+                    "delta": True,
+                    "backpressure": "CONFLATE",
+                }))
+            await asyncio.wait_for(ws.recv(), timeout=1.0)
+    except websockets.ConnectionClosedError as e:
+        caught = True
+        assert e.code == 4000
+        assert e.reason == "Option delta can't be combined with CONFLATE backpressure."
+    assert caught
+
+
+async def test_aggregate(api_proc):
+    p = a0.Publisher("mytopic")
+    for i in range(5):
+        p.pub(json.dumps({"pose": {"x": i}, "name": "arm"}))
+    p.pub("not json")
+
+    async with websockets.connect(api_proc.addr("wsapi", "sub")) as ws:
+        await ws.send(
+            json.dumps({
+                "topic": "mytopic",
+                "init": "OLDEST",
+                "aggregate": {
+                    "fields": ["/pose/x", "/name"],
+                    "window_ms": 200,
+                },
+            }))
+
+        # The packets may straddle a window boundary.
+        windows = []
+        try:
+            while sum(w["count"] for w in windows) < 5:
+                windows.append(json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0)))
+        except asyncio.TimeoutError:
+            assert False
+
+        assert all(w["window_ms"] == 200 for w in windows)
+        assert all(w["fields"]["/name"] is None for w in windows)
+        stats = [w["fields"]["/pose/x"] for w in windows]
+        assert sum(s["count"] for s in stats) == 5
+        assert stats[0]["min"] == 0
+        assert stats[-1]["max"] == 4
+        assert stats[-1]["last"] == 4
+
+
+async def test_aggregate_delta(api_proc):
+    caught = False
+    try:
+        async with websockets.connect(api_proc.addr("wsapi", "sub")) as ws:
+            await ws.send(
+                json.dumps({
+                    "topic": "mytopic",
+                    "delta": True,
+                    "aggregate": {"fields": ["/x"], "window_ms": 1000},
+                }))
+            await asyncio.wait_for(ws.recv(), timeout=1.0)
+    except websockets.ConnectionClosedError as e:
+        caught = True
+        assert e.code == 4000
+        assert e.reason == "Option aggregate can't be combined with delta."
+    assert caught
+
+
+async def test_chunked(api_proc):
+    payload = bytes(range(256)) * 40
+    p = a0.Publisher("mytopic")
+    p.pub(payload)
+    p.pub("small")
+
+    async with websockets.connect(api_proc.addr("wsapi", "sub")) as ws:
+        await ws.send(
+            json.dumps({
+                "topic": "mytopic",
+                "init": "OLDEST",
+                "chunk_size": 4096,
+            }))
+
+        try:
+            # Rounded down to a multiple of 3 bytes.
+            frags = [
+                json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+                for _ in range(3)
+            ]
+            pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+        except asyncio.TimeoutError:
+            assert False
+
+        assert "headers" in frags[0]
+        assert all("headers" not in frag for frag in frags[1:])
+        assert len({frag["chunk"]["id"] for frag in frags}) == 1
+        assert [frag["chunk"]["offset"] for frag in frags] == [0, 4095, 8190]
+        assert all(frag["chunk"]["total"] == len(payload) for frag in frags)
+        assert base64.b64decode("".join(frag["payload"] for frag in frags)) == payload
+
+        assert "chunk" not in pkt
+        assert pkt["payload"] == "small"
+
+
+async def test_catchup(api_proc):
+    p = a0.Publisher("mytopic")
+    for i in range(5):
+        p.pub(f"payload {i}")
+
+    async with websockets.connect(api_proc.addr("wsapi", "sub")) as ws:
+        await ws.send(
+            json.dumps({
+                "topic": "mytopic",
+                "init": "OLDEST",
+                "catchup": True,
+            }))
+
+        try:
+            msg = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+        except asyncio.TimeoutError:
+            assert False
+        assert msg["live"]
+        assert [pkt["payload"] for pkt in msg["batch"]] == [f"payload {i}" for i in range(5)]
+
+        p.pub("payload 5")
+        try:
+            pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+        except asyncio.TimeoutError:
+            assert False
+        assert "batch" not in pkt
+        assert pkt["payload"] == "payload 5"
+
+
+async def test_catchup_empty(api_proc):
+    async with websockets.connect(api_proc.addr("wsapi", "sub")) as ws:
+        await ws.send(
+            json.dumps({
+                "topic": "mytopic",
+                "init": "OLDEST",
+                "catchup": True,
+            }))
+
+        # Marked live before anything is published.
+        try:
+            msg = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+        except asyncio.TimeoutError:
+            assert False
+        assert msg == {"batch": [], "live": True}
+
+        a0.Publisher("mytopic").pub("payload 0")
+        try:
+            pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+        except asyncio.TimeoutError:
+            assert False
+        assert pkt["payload"] == "payload 0"
@@ -0,0 +1,51 @@
+import a0
+import asyncio
+import http.client
+import json
+import os
+import socket
+import websockets
+
+
+class UnixHTTPConnection(http.client.HTTPConnection):
+
+    def __init__(self, path):
+        super().__init__("localhost")
+        self.path = path
+
+    def connect(self):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(self.path)
+
+
+def test_rest(api_proc_unix):
+    a0.File("aaa/bbb.pubsub.a0")
+
+    conn = UnixHTTPConnection(os.environ["API_UNIX_SOCKET"])
+    conn.request("GET", "/api/ls")
+    resp = conn.getresponse()
+    assert resp.status == 200
+    assert json.loads(resp.read()) == ["aaa/bbb.pubsub.a0"]
+
+
+async def test_sub(api_proc_unix):
+    p = a0.Publisher("mytopic")
+    p.pub("payload 0")
+
+    async with websockets.unix_connect(os.environ["API_UNIX_SOCKET"],
+                                       "ws://localhost/wsapi/sub") as ws:
+        await ws.send(json.dumps({
+            "topic": "mytopic",
+            "init": "OLDEST",
+        }))
+
+        try:
+            pkt = json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+            assert pkt["payload"] == "payload 0"
+        except asyncio.TimeoutError:
+            assert False
+
+
+def test_mode(api_proc_unix):
+    # Only the owner may connect, unless API_UNIX_SOCKET_MODE says otherwise.
+    assert os.stat(os.environ["API_UNIX_SOCKET"]).st_mode & 0o777 == 0o600
@@ -0,0 +1,188 @@
+import a0
+import asyncio
+import json
+import pytest
+import types
+import websockets
+
+
+@pytest.fixture()
+def rpc_server():
+    ns = types.SimpleNamespace()
+    ns.collected_requests = []
+    ns.held_requests = []
+    ns.cancel_ids = []
+
+    def on_request(req):
+        ns.collected_requests.append(req.pkt.payload)
+        if req.pkt.payload == b"hold":
+            ns.held_requests.append(req)
+            return
+        req.reply(b"reply " + req.pkt.payload)
+
+    def on_cancel(id_):
+        ns.cancel_ids.append(id_)
+
+    ns.server = a0.RpcServer("mytopic", on_request, on_cancel)
+
+    yield ns
+
+
+async def recv_json(ws):
+    try:
+        return json.loads(await asyncio.wait_for(ws.recv(), timeout=1.0))
+    except asyncio.TimeoutError:
+        assert False
+
+
+async def test_pipelined(api_proc, rpc_server):
+    async with websockets.connect(api_proc.addr("wsapi", "rpc")) as ws:
+        for i in range(10):
+            await ws.send(
+                json.dumps({
+                    "id": i,
+                    "topic": "mytopic",
+                    "packet": {
+                        "payload": f"request {i}",
+                    },
+                }))
+
+        replies = {}
+        for _ in range(10):
+            pkt = await recv_json(ws)
+            replies[pkt["id"]] = pkt["payload"]
+        assert replies == {i: f"reply request {i}" for i in range(10)}
+
+    assert sorted(rpc_server.collected_requests) == sorted(
+        [f"request {i}".encode() for i in range(10)])
+
+
+async def test_timeout(api_proc, rpc_server):
+    async with websockets.connect(api_proc.addr("wsapi", "rpc")) as ws:
+        await ws.send(
+            json.dumps({
+                "id": "slow",
+                "topic": "mytopic",
+                "packet": {
+                    "payload": "hold",
+                },
+                "timeout_ms": 100,
+            }))
+        await ws.send(
+            json.dumps({
+                "id": "fast",
+                "topic": "mytopic",
+                "packet": {
+                    "payload": "request",
+                },
+                "timeout_ms": 1000,
+            }))
+
+        assert (await recv_json(ws))["id"] == "fast"
+        assert await recv_json(ws) == {"id": "slow", "error": "Deadline exceeded."}
+
+    assert len(rpc_server.cancel_ids) == 1
+
+
+async def test_cancel(api_proc, rpc_server):
+    async with websockets.connect(api_proc.addr("wsapi", "rpc")) as ws:
+        await ws.send(
+            json.dumps({
+                "id": 1,
+                "topic": "mytopic",
+                "packet": {
+                    "payload": "hold",
+                },
+            }))
+        await asyncio.sleep(0.1)
+        await ws.send(json.dumps({"id": 1, "cancel": True}))
+
+        assert await recv_json(ws) == {"id": 1, "error": "Cancelled."}
+
+        # Answered exactly once.
+        rpc_server.held_requests[0].reply("late")
+        timed_out = False
+        try:
+            await asyncio.wait_for(ws.recv(), timeout=1.0)
+        except asyncio.TimeoutError:
+            timed_out = True
+        assert timed_out
+
+    assert len(rpc_server.cancel_ids) == 1
+
+
+async def test_id_reuse(api_proc, rpc_server):
+
+    async def expect_silence(ws):
+        timed_out = False
+        try:
+            await asyncio.wait_for(ws.recv(), timeout=0.5)
+        except asyncio.TimeoutError:
+            timed_out = True
+        assert timed_out
+
+    async with websockets.connect(api_proc.addr("wsapi", "rpc")) as ws:
+        # Answered, then reused. The first deadline doesn't apply to the second.
+        await ws.send(
+            json.dumps({
+                "id": 1,
+                "topic": "mytopic",
+                "packet": {
+                    "payload": "request",
+                },
+                "timeout_ms": 300,
+            }))
+        assert (await recv_json(ws))["payload"] == "reply request"
+        await ws.send(
+            json.dumps({
+                "id": 1,
+                "topic": "mytopic",
+                "packet": {
+                    "payload": "hold",
+                },
+                "timeout_ms": 2000,
+            }))
+        await expect_silence(ws)
+
+        # Cancelled, then reused. A late reply to the first isn't taken for the second.
+        await ws.send(json.dumps({"id": 1, "cancel": True}))
+        assert await recv_json(ws) == {"id": 1, "error": "Cancelled."}
+        await ws.send(
+            json.dumps({
+                "id": 1,
+                "topic": "mytopic",
+                "packet": {
+                    "payload": "hold",
+                },
+                "timeout_ms": 2000,
+            }))
+        await asyncio.sleep(0.1)
+        rpc_server.held_requests[0].reply("late")
+        await expect_silence(ws)
+
+        rpc_server.held_requests[1].reply("fresh")
+        pkt = await recv_json(ws)
+        assert pkt["id"] == 1
+        assert pkt["payload"] == "fresh"
+
+
+async def test_errors(api_proc, rpc_server):
+    async with websockets.connect(api_proc.addr("wsapi", "rpc")) as ws:
+        await ws.send(json.dumps({"topic": "mytopic"}))
+        assert await recv_json(ws) == {
+            "id": None,
+            "error": "Request missing required field: id",
+        }
+
+        await ws.send(json.dumps({"id": 1, "packet": {"payload": ""}}))
+        assert await recv_json(ws) == {
+            "id": 1,
+            "error": "Request missing required field: topic",
+        }
+
+        await ws.send(json.dumps({"id": 2, "topic": "mytopic", "packet": {"payload": "hold"}}))
+        await ws.send(json.dumps({"id": 2, "topic": "mytopic", "packet": {"payload": "hold"}}))
+        assert await recv_json(ws) == {
+            "id": 2,
+            "error": "Request id already pending.",
+        }